@@ -0,0 +1,200 @@
+#ifndef ADCSCANNER_H
+#define ADCSCANNER_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "RingBuffer.h"
+
+const uint8_t BUTTON_LADDERS = 4;
+const uint8_t BUTTON_DEBOUNCE_SAMPLES = 24; // about 20 ms at one sample per ladder every 832 us
+const uint8_t BUTTON_RELEASED = 0x80;       // event flag, the button index is in the low bits
+
+/**
+ * A resistor ladder of buttons on one analog pin, with the same interface as
+ * AnalogMultiButton. The AdcScanner ISR feeds it samples, debounces them and
+ * queues press and release events; update() takes one event per call, so
+ * the main loop never waits for a conversion.
+ */
+class ButtonLadder
+{
+private:
+  const int *values;
+  uint8_t total;
+
+  // written by the ISR only
+  int8_t candidate = -1;
+  uint8_t stable = 0;
+  int8_t debounced = -1;
+  RingBuffer<uint8_t, 8> events;
+
+  // main loop only
+  int8_t buttonPressed = -1;
+  int8_t buttonOnPress = -1;
+  int8_t buttonOnRelease = -1;
+  int8_t pressAfterFired = -1;
+  uint32_t pressStart = 0;
+  uint32_t releasedDuration = 0;
+
+  // the button whose value is nearest, -1 above the last one (nothing pressed)
+  int8_t buttonFor(uint16_t value) const
+  {
+    for (uint8_t i = 0; i < total; i++)
+    {
+      int upper = (i + 1 < total) ? (values[i] + values[i + 1]) / 2 : (values[i] + 1024) / 2;
+      if ((int)value <= upper)
+        return i;
+    }
+    return -1;
+  }
+
+public:
+  const uint8_t channel; // ADC multiplexer channel
+
+  /**
+   * @param pin the analog pin of the ladder, A0..A7
+   * @param total number of buttons
+   * @param values ADC reading of each button, ascending
+   */
+  ButtonLadder(uint8_t pin, uint8_t total, const int values[])
+      : values(values), total(total), channel(pin - A0) {}
+
+  /** debounces one conversion result; called from the ADC interrupt */
+  inline void sample(uint16_t value)
+  {
+    int8_t button = buttonFor(value);
+    if (button != candidate)
+    {
+      candidate = button;
+      stable = 0;
+    }
+    else if (stable < BUTTON_DEBOUNCE_SAMPLES)
+      stable++;
+
+    if (stable < BUTTON_DEBOUNCE_SAMPLES || button == debounced)
+      return;
+
+    if (debounced != -1)
+      events.push(debounced | BUTTON_RELEASED);
+    if (button != -1)
+      events.push(button);
+    debounced = button;
+  }
+
+  void update()
+  {
+    buttonOnPress = -1;
+    buttonOnRelease = -1;
+
+    uint8_t event;
+    if (!events.pop(event))
+      return;
+
+    uint32_t now = millis();
+    if (event & BUTTON_RELEASED)
+    {
+      buttonOnRelease = event & ~BUTTON_RELEASED;
+      releasedDuration = now - pressStart;
+      buttonPressed = -1;
+    }
+    else
+    {
+      buttonOnPress = event;
+      buttonPressed = event;
+      pressStart = now;
+    }
+  }
+
+  /**
+   * Drops the queued events while keeping track of the button held, for
+   * while nothing reads the ladder, so those presses are not reported later
+   */
+  void flush()
+  {
+    do
+      update();
+    while (buttonOnPress != -1 || buttonOnRelease != -1);
+  }
+
+  bool isPressed(int button) { return buttonPressed == button; }
+  bool onPress(int button) { return buttonOnPress == button; }
+  bool onRelease(int button) { return buttonOnRelease == button; }
+
+  bool onPressAfter(int button, int duration)
+  {
+    if (!isPressed(button))
+      return false;
+    if (onPress(button))
+      pressAfterFired = -1;
+    if (pressAfterFired != button && millis() - pressStart >= (uint32_t)duration)
+    {
+      pressAfterFired = button;
+      return true;
+    }
+    return false;
+  }
+
+  bool onReleaseBefore(int button, int duration) { return onRelease(button) && releasedDuration < (uint32_t)duration; }
+  bool onReleaseAfter(int button, int duration) { return onRelease(button) && releasedDuration >= (uint32_t)duration; }
+
+  unsigned long getPressDuration() { return buttonPressed == -1 ? 0 : millis() - pressStart; }
+};
+
+/**
+ * Runs the ADC in free running mode and reads the button ladders round
+ * robin from its interrupt. A conversion starts as soon as the previous one
+ * ends, so the one running when the multiplexer moves on still samples the
+ * old channel and is skipped. At prescaler 128 a conversion takes 104 us and
+ * every ladder is sampled each 832 us.
+ */
+class AdcScanner
+{
+private:
+  ButtonLadder *ladders[BUTTON_LADDERS];
+  uint8_t current = 0;
+  bool skip = false;
+
+  inline void select(uint8_t ladder) { ADMUX = _BV(REFS0) | ladders[ladder]->channel; } // AVcc reference
+
+public:
+  static AdcScanner *singleton; // used inside the ISR
+
+  AdcScanner(ButtonLadder *a, ButtonLadder *b, ButtonLadder *c, ButtonLadder *d)
+      : ladders{a, b, c, d}
+  {
+    AdcScanner::singleton = this;
+  }
+
+  /** starts the conversions; analogRead() must not be used afterwards */
+  void begin()
+  {
+    current = 0;
+    skip = false;
+    select(current);
+    ADCSRB = 0; // free running
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  }
+
+  inline void conversion(uint16_t value)
+  {
+    if (skip)
+    {
+      skip = false;
+      return;
+    }
+
+    ladders[current]->sample(value);
+    current = (current + 1) % BUTTON_LADDERS;
+    select(current);
+    skip = true;
+  }
+};
+
+AdcScanner *AdcScanner::singleton = {0};
+
+// ADC conversion complete interrupt service routine
+ISR(ADC_vect)
+{
+  AdcScanner::singleton->conversion(ADC);
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef CLOCKTRACKER_H
+#define CLOCKTRACKER_H
+
+#include <Arduino.h>
+
+const uint8_t CLOCKTRACKER_WINDOW = 5; // intervals in the median prefilter
+
+/**
+ * Tempo tracker for an external clock. Pulse intervals go through a
+ * median-of-5 prefilter, so a single late or early pulse (which distorts
+ * two intervals) is rejected outright, and then a first-order loop filter
+ * (gain 1/4) that follows slow drift. A jump of more than 1/8 is taken as
+ * a tempo change and snapped to, which the median lets through after three
+ * pulses. Phase comes from the pulses themselves, so the predicted next
+ * pulse is the last pulse plus the smoothed period.
+ */
+class ClockTracker
+{
+private:
+  uint32_t intervals[CLOCKTRACKER_WINDOW];
+  uint8_t intervalCount = 0;
+  uint8_t intervalIndex = 0;
+  uint32_t lastPulse = 0;
+  uint32_t smoothed = 0; // microseconds
+  bool hasPulse = false;
+
+  uint32_t medianInterval()
+  {
+    uint32_t sorted[CLOCKTRACKER_WINDOW];
+    for (uint8_t i = 0; i < intervalCount; i++)
+    {
+      uint8_t j = i;
+      for (; j > 0 && sorted[j - 1] > intervals[i]; j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = intervals[i];
+    }
+    return sorted[intervalCount / 2];
+  }
+
+public:
+  ClockTracker() {}
+
+  void reset()
+  {
+    intervalCount = 0;
+    intervalIndex = 0;
+    smoothed = 0;
+    hasPulse = false;
+  }
+
+  /**
+   * Feeds one clock pulse into the tracker
+   * @param at micros() timestamp of the pulse
+   */
+  void pulse(uint32_t at)
+  {
+    if (hasPulse)
+    {
+      intervals[intervalIndex] = at - lastPulse;
+      intervalIndex = (intervalIndex + 1) % CLOCKTRACKER_WINDOW;
+      if (intervalCount < CLOCKTRACKER_WINDOW)
+        intervalCount++;
+
+      uint32_t estimate = medianInterval();
+      uint32_t difference = (estimate > smoothed) ? estimate - smoothed : smoothed - estimate;
+
+      if (smoothed == 0 || difference > smoothed / 8)
+        smoothed = estimate;
+      else
+        smoothed += ((int32_t)estimate - (int32_t)smoothed) / 4;
+    }
+
+    lastPulse = at;
+    hasPulse = true;
+  }
+
+  bool isLocked() { return smoothed != 0; }
+
+  /** smoothed pulse period in microseconds, 0 until two pulses were seen */
+  uint32_t period() { return smoothed; }
+
+  /** micros() at which the next pulse is expected */
+  uint32_t predictNext() { return lastPulse + smoothed; }
+};
+
+#endif
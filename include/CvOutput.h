@@ -0,0 +1,57 @@
+#ifndef CVOUTPUT_H
+#define CVOUTPUT_H
+
+#include <Arduino.h>
+#include "dac.h"
+
+const uint16_t CV_RATE = 2500; // DAC updates per second, a divisor of the Timer2 rate
+
+/**
+ * Fixed-rate CV output. The Timer2 interrupt calls tick() and every
+ * CV_RATE-th of a second the pitch source is sampled and written to DAC
+ * channel 0, so the control rate no longer depends on how long a pass
+ * through loop() takes.
+ *
+ * Nothing else writes to the DAC, which keeps the SPI bus owned by a
+ * single context.
+ */
+class CvOutput
+{
+private:
+  int16_t (*pitch)() = nullptr;
+  uint8_t divider = 0;
+  uint8_t decimation = 1;
+
+public:
+  static CvOutput *singleton; // used inside the ISR
+  MP4822 dac;
+
+  CvOutput() { CvOutput::singleton = this; }
+
+  /**
+   * Sets the function sampled for channel 0 at every control tick; it runs
+   * inside the interrupt
+   * @param source returns the pitch to output, 0..4000
+   */
+  void setPitchSource(int16_t (*source)()) { pitch = source; }
+
+  /**
+   * Sets how often tick() is called
+   * @param tickRate calls per second, a multiple of CV_RATE
+   */
+  void begin(uint16_t tickRate) { decimation = tickRate / CV_RATE; }
+
+  inline void tick()
+  {
+    if (++divider < decimation)
+      return;
+    divider = 0;
+
+    if (pitch)
+      dac.DAC_set(0, pitch());
+  }
+};
+
+CvOutput *CvOutput::singleton = {0};
+
+#endif
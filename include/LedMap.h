@@ -0,0 +1,50 @@
+#ifndef LEDMAP_H
+#define LEDMAP_H
+
+#include <Arduino.h>
+
+// Front panel wiring of the 74HC595 chain. The sequence lights take the first
+// pins, the 16 status pins (knob modes, buttons and the clock and gate
+// outputs) follow them. An expansion panel with more registers sets
+// ShiftRegisterPWM_REGISTERS and, for more steps, ShiftRegisterPWM_STEP_LIGHTS;
+// pins after the status block are free for extra status LEDs.
+#ifndef ShiftRegisterPWM_REGISTERS
+#define ShiftRegisterPWM_REGISTERS 4
+#endif
+
+#ifndef ShiftRegisterPWM_STEP_LIGHTS
+#define ShiftRegisterPWM_STEP_LIGHTS 16
+#endif
+
+constexpr uint8_t LED_REGISTERS = ShiftRegisterPWM_REGISTERS;
+constexpr uint8_t LED_PINS = LED_REGISTERS * 8;
+constexpr uint8_t LED_STEPS = ShiftRegisterPWM_STEP_LIGHTS; // pins 0..LED_STEPS-1
+constexpr uint8_t LED_STATUS = LED_STEPS;                    // first status pin
+
+static_assert(LED_REGISTERS >= 4 && LED_REGISTERS <= 8, "ShiftRegisterPWM_REGISTERS must be 4..8");
+static_assert(LED_STEPS >= 16, "the value picker needs 16 sequence lights");
+static_assert(LED_STATUS + 16 <= LED_PINS, "the chain has no room for the 16 status pins after the sequence lights");
+
+const uint8_t ledKnob[] PROGMEM = {LED_STATUS + 0, LED_STATUS + 1, LED_STATUS + 2, LED_STATUS + 3, LED_STATUS + 4,
+                                   LED_STATUS + 5, LED_STATUS + 6, LED_STATUS + 7, LED_STATUS + 8};
+constexpr uint8_t ledSHIFT = LED_STATUS + 9;
+constexpr uint8_t ledClock = LED_STATUS + 10;
+constexpr uint8_t ledGate = LED_STATUS + 11;
+constexpr uint8_t ledENTER = LED_STATUS + 12;
+constexpr uint8_t outClock = LED_STATUS + 13;
+constexpr uint8_t outGate = LED_STATUS + 14;
+constexpr uint8_t ledPLAY = LED_STATUS + 15;
+
+// the smallest unsigned type with a bit per pin of a chain
+template <uint8_t REGISTERS>
+struct LedBits
+{
+    typedef uint64_t type;
+};
+template <>
+struct LedBits<4>
+{
+    typedef uint32_t type;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef QUADRATUREDECODER_H
+#define QUADRATUREDECODER_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+const uint8_t ENCODER_COUNT = 3;
+
+// quarter steps per transition, indexed by previous state << 2 | new state,
+// a state being B | A << 1; invalid (skipped) transitions count 0
+const int8_t quadratureSteps[16] PROGMEM = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+const uint8_t QUADRATURE_DETENT = 3; // both contacts open, where the knobs rest
+
+/**
+ * Pin change interrupt decoder for the three rotary encoders: knob 1 on
+ * A0/A1 and knob 2 on A2/A3 (PCINT1), knob 3 on D8/D9 (PCINT0). Every edge
+ * is decoded in the ISR through a state transition table and whole detents
+ * are added to a free-running byte counter per encoder. The main loop takes
+ * the difference to what it read last, so detents are never lost while it
+ * is busy and neither side disables interrupts.
+ */
+class QuadratureDecoder
+{
+private:
+  uint8_t state[ENCODER_COUNT];
+  int8_t quarters[ENCODER_COUNT];          // ISR only, steps since the last detent
+  volatile uint8_t detents[ENCODER_COUNT]; // written by the ISR only
+  uint8_t taken[ENCODER_COUNT];            // written by the main loop only
+
+  static inline uint8_t readState(uint8_t port, uint8_t bitA)
+  {
+    return ((port >> (bitA + 1)) & 1) | (((port >> bitA) & 1) << 1);
+  }
+
+public:
+  static QuadratureDecoder *singleton; // used inside the ISR
+
+  QuadratureDecoder() { QuadratureDecoder::singleton = this; }
+
+  /**
+   * Sets up the encoder pins and starts decoding
+   */
+  void begin()
+  {
+    DDRC &= ~0x0F; // A0-A3 inputs with pull-ups
+    PORTC |= 0x0F;
+    DDRB &= ~0x03; // D8, D9
+    PORTB |= 0x03;
+
+    state[0] = readState(PINC, 0);
+    state[1] = readState(PINC, 2);
+    state[2] = readState(PINB, 0);
+    for (uint8_t i = 0; i < ENCODER_COUNT; i++)
+    {
+      quarters[i] = 0;
+      taken[i] = detents[i];
+    }
+
+    PCMSK1 |= 0x0F;
+    PCMSK0 |= 0x03;
+    PCICR |= _BV(PCIE1) | _BV(PCIE0);
+  }
+
+  /**
+   * Decodes the new pin state of one encoder; called from the pin change ISRs
+   * @param encoder 0..2
+   * @param now B | A << 1
+   */
+  inline void decode(uint8_t encoder, uint8_t now)
+  {
+    uint8_t previous = state[encoder];
+    if (now == previous)
+      return;
+    state[encoder] = now;
+
+    int8_t q = quarters[encoder] + (int8_t)pgm_read_byte_near(quadratureSteps + (previous << 2 | now));
+    if (now == QUADRATURE_DETENT)
+    {
+      detents[encoder] += q / 4; // a full cycle, or none if the knob bounced back
+      q = 0;
+    }
+    quarters[encoder] = q;
+  }
+
+  inline void portC(uint8_t pins)
+  {
+    decode(0, readState(pins, 0));
+    decode(1, readState(pins, 2));
+  }
+
+  inline void portB(uint8_t pins) { decode(2, readState(pins, 0)); }
+
+  /**
+   * Detents turned since the last call, clockwise positive
+   * @param encoder 0..2
+   */
+  int8_t take(uint8_t encoder)
+  {
+    uint8_t now = detents[encoder];
+    int8_t turned = now - taken[encoder];
+    taken[encoder] = now;
+    return turned;
+  }
+};
+
+QuadratureDecoder *QuadratureDecoder::singleton = {0};
+
+// Pin change interrupt service routines, knobs 1 and 2 on PORTC and knob 3 on PORTB
+ISR(PCINT1_vect)
+{
+  QuadratureDecoder::singleton->portC(PINC);
+}
+
+ISR(PCINT0_vect)
+{
+  QuadratureDecoder::singleton->portB(PINB);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <Arduino.h>
+
+// keeps the compiler from moving item stores/loads across the index update
+#define RINGBUFFER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/**
+ * Lock-free single-producer/single-consumer queue for handing events from
+ * an ISR to the main loop (or back). Each index is written by one side only
+ * and is a single byte, so neither side ever needs to disable interrupts.
+ * @tparam T item type
+ * @tparam SIZE capacity, a power of two no larger than 128
+ */
+template <typename T, uint8_t SIZE>
+class RingBuffer
+{
+  static_assert(SIZE && (SIZE & (SIZE - 1)) == 0 && SIZE <= 128, "RingBuffer SIZE must be a power of two <= 128");
+
+private:
+  T items[SIZE];
+  volatile uint8_t head = 0; // written by the producer only
+  volatile uint8_t tail = 0; // written by the consumer only
+
+public:
+  volatile uint8_t dropped = 0; // pushes refused because the queue was full
+
+  bool push(const T &item)
+  {
+    uint8_t h = head;
+    if ((uint8_t)(h - tail) >= SIZE)
+    {
+      dropped++;
+      return false;
+    }
+    items[h & (SIZE - 1)] = item;
+    RINGBUFFER_BARRIER();
+    head = h + 1;
+    return true;
+  }
+
+  bool pop(T &item)
+  {
+    uint8_t t = tail;
+    if (t == head)
+      return false;
+    item = items[t & (SIZE - 1)];
+    RINGBUFFER_BARRIER();
+    tail = t + 1;
+    return true;
+  }
+
+  bool isEmpty() { return head == tail; }
+  uint8_t count() { return head - tail; }
+
+  /** discards everything queued; consumer side only */
+  void clear() { tail = head; }
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef STEPCLOCK_H
+#define STEPCLOCK_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "CvOutput.h"
+
+const uint16_t STEPCLOCK_RATE = 10000; // Timer2 compare matches per second
+const uint8_t STEPCLOCK_FRACTION = 16; // step lengths are Q16 timer ticks
+
+/**
+ * Step clock driven by the Timer2 compare interrupt. Step lengths are held
+ * as Q16 fixed-point ticks and counted down with the remainder carried into
+ * the next step, so the average tempo is exact however the period divides
+ * into ticks and no step ever inherits main loop latency. Even and odd steps
+ * have their own length for shuffle.
+ *
+ * The ISR only produces events; the main loop consumes them with done().
+ */
+class StepClock
+{
+private:
+  volatile int32_t remaining = 0; // Q16 ticks left in the current step
+  volatile uint32_t evenLength = 0;
+  volatile uint32_t oddLength = 0;
+  volatile bool odd = false;      // parity of the step in progress
+  volatile uint8_t produced = 0;  // written by the ISR only
+  uint8_t consumed = 0;           // written by the main loop only
+
+public:
+  static StepClock *singleton; // used inside the ISR
+  volatile bool running = false;
+
+  StepClock() { StepClock::singleton = this; }
+
+  /**
+   * Converts a tempo to the Q16 tick length of one beat.
+   * @param centiBpm beats per minute x 100
+   */
+  static uint32_t beatLength(uint32_t centiBpm)
+  {
+    return ((uint64_t)60UL * 100 * STEPCLOCK_RATE << STEPCLOCK_FRACTION) / centiBpm;
+  }
+
+  /**
+   * Sets the length of even and odd steps and retimes the step in progress,
+   * keeping its start.
+   * @param evenTicks length of even steps in Q16 ticks
+   * @param oddTicks length of odd steps in Q16 ticks
+   */
+  void setLengths(uint32_t evenTicks, uint32_t oddTicks)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      int32_t current = odd ? oddLength : evenLength;
+      evenLength = evenTicks;
+      oddLength = oddTicks;
+      remaining += (int32_t)(odd ? oddTicks : evenTicks) - current;
+    }
+  }
+
+  void start()
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      remaining = odd ? oddLength : evenLength;
+      consumed = produced;
+      running = true;
+    }
+  }
+
+  void stop() { running = false; }
+
+  /** sets the parity of the step in progress */
+  void setOdd(bool isOdd) { odd = isOdd; }
+
+  /** consumes one step event, true if the ISR produced one since the last call */
+  bool done()
+  {
+    if (consumed == produced)
+      return false;
+    consumed++;
+    return true;
+  }
+
+  inline void tick()
+  {
+    if (!running)
+      return;
+
+    remaining -= (int32_t)1 << STEPCLOCK_FRACTION;
+    if (remaining <= 0)
+    {
+      odd = !odd;
+      remaining += odd ? oddLength : evenLength;
+      produced++;
+    }
+  }
+
+  /**
+   * Initializes and starts Timer2 in CTC mode at STEPCLOCK_RATE.
+   * Must be called from setup(), after the Arduino core has claimed Timer2 for PWM.
+   */
+  void interrupt() const
+  {
+    cli();
+    TCCR2A = (1 << WGM21);                         // CTC mode
+    TCCR2B = (1 << CS21);                          // prescaler 8
+    TCNT2 = 0;
+    OCR2A = F_CPU / 8 / STEPCLOCK_RATE - 1;        // 199 @ 16 MHz
+    TIMSK2 |= (1 << OCIE2A);                       // enable timer compare interrupt
+    sei();
+  }
+};
+
+StepClock *StepClock::singleton = {0};
+
+// Timer 2 interrupt service routine (ISR), which also paces the CV output
+ISR(TIMER2_COMPA_vect)
+{
+  StepClock::singleton->tick();
+  if (CvOutput::singleton)
+    CvOutput::singleton->tick();
+}
+
+#endif
@@ -3,53 +3,151 @@
 
 #include <SPI.h>
 
+#ifndef DAC_DIRECT_IO
+#define DAC_DIRECT_IO true // drive CS and SPDR directly instead of digitalWrite()/SPI.transfer()
+#endif
+
+// The original board ties the MCP4822's LDAC pin (5) to GND, so each channel
+// changes as its chip select rises, a word apart. DAC_LDAC_LATCH drives LDAC
+// from D7 instead and pulses it once both channels are sent, so they change
+// together; it needs pin 5 cut from GND and wired to D7.
+#ifndef DAC_LDAC_LATCH
+#define DAC_LDAC_LATCH false
+#endif
+
 const uint8_t DAC_CS   = 10;   // Chip select pin for the DAC
+const uint8_t DAC_CS_BIT = 2;  // D10 is PB2
+#if (DAC_LDAC_LATCH)
+const uint8_t DAC_LDAC = 7;    // Latch pin, moves both input registers to the outputs when pulled low
+const uint8_t DAC_LDAC_BIT = 7; // D7 is PD7
+#endif
+const uint16_t DAC_NO_WORD = 0xFFFF; // never a valid command word, bit 14 is always 0
 
 class MP4822
 {
+private:
+  uint16_t lastWord[2] = {DAC_NO_WORD, DAC_NO_WORD};
+  uint16_t stagedWord[2];
+  uint8_t staged = 0; // bit per channel with a word waiting for latch()
+
+  // sends one 16 bit command word
+  inline void transfer(uint16_t word)
+  {
+#if (DAC_DIRECT_IO)
+    PORTB &= ~_BV(DAC_CS_BIT);  // select the chip
+    SPDR = word >> 8;
+    uint8_t lsb = word;         // prepared while the first byte shifts out
+    while (!(SPSR & _BV(SPIF)))
+      ;
+    SPDR = lsb;
+    while (!(SPSR & _BV(SPIF)))
+      ;
+    PORTB |= _BV(DAC_CS_BIT);   // de-select, the word lands in the input register
+#else
+    digitalWrite(DAC_CS, LOW);  // take the CS pin low to select the chip:
+    SPI.transfer(word >> 8);    //  send in the address and value via SPI:
+    SPI.transfer(word & 0xFF);
+    digitalWrite(DAC_CS, HIGH); // take the CS pin high to de-select the chip:
+#endif
+  }
+
+  // moves both input registers to the outputs at the same instant
+  inline void pulseLatch()
+  {
+#if (DAC_LDAC_LATCH) && (DAC_DIRECT_IO)
+    PORTD &= ~_BV(DAC_LDAC_BIT); // two cycles low, the MCP4822 needs 100 ns
+    PORTD |= _BV(DAC_LDAC_BIT);
+#elif (DAC_LDAC_LATCH)
+    digitalWrite(DAC_LDAC, LOW);
+    digitalWrite(DAC_LDAC, HIGH);
+#endif
+  }
+
 public:
+  volatile uint32_t writesIssued = 0;  // words sent over SPI
+  volatile uint32_t writesSkipped = 0; // words dropped because the channel already held them
+
   MP4822()
   {
     pinMode(DAC_CS, OUTPUT);
+    digitalWrite(DAC_CS, HIGH);
+#if (DAC_LDAC_LATCH)
+    pinMode(DAC_LDAC, OUTPUT);
+    digitalWrite(DAC_LDAC, HIGH);
+#endif
     SPI.begin();
   }
 
   ~MP4822() {
     SPI.end();
-  }  
+  }
+
+  /**
+   * Builds the MCP4822 command word for a channel
+   * @param channel 0 = A, 1 = B
+   * @param input 0..4095
+   * @param gain 0 = 2x Vref, 1 = 1x Vref
+   */
+  static uint16_t commandWord(uint8_t channel, uint16_t input, uint8_t gain = 0)
+  {
+    uint16_t word = input & 0x0FFF;
+    if (channel == 1)
+      word |= 0x8000; // DAC B
+    if (gain == 0)
+      word |= 0x2000;
+    return word | 0x1000; // get out of shutdown mode to active state
+  }
 
   //function to set state of DAC - input value between 0-4095
+  //a write the channel already holds is skipped
   void DAC_set(uint8_t channel, int16_t inputVoltage, uint8_t gain = 0)
   {
-    uint16_t input = constrain(inputVoltage, 0, 4000);
-
-    //DAC_sel choose which DAC channel you want to write to A or B
-    //Gain_sel choose your gain: H=2xVref and L=1xVref
-    uint8_t MSB, LSB; //most sig, least sig bytes and config info
-
-    //convert decimal input to binary stored in two bytes
-    MSB = (input >> 8) & 0xFF; //most sig byte
-    LSB = input & 0xFF;        //least sig byte
-
-    //apply config bits to the front of MSB
-    if (channel == 0)
-      MSB &= 0x7F; //writing a 0 to bit 7.
-    else if (channel == 1)
-      MSB |= 0x80; //writing a 1 to bit 7.
+    stage(channel, inputVoltage, gain);
+    latch();
+  }
 
-    if (gain == 0)
-      MSB |= 0x20;
-    else if (gain == 1)
-      MSB &= 0x1F;
+  /**
+   * Prepares a channel's next word without sending it; latch() sends
+   * everything staged and updates the outputs together
+   */
+  void stage(uint8_t channel, int16_t inputVoltage, uint8_t gain = 0)
+  {
+    uint16_t word = commandWord(channel, constrain(inputVoltage, 0, 4000), gain);
+    channel &= 1;
+    if (word == lastWord[channel])
+    {
+      staged &= ~(1 << channel);
+      writesSkipped++;
+      return;
+    }
+    stagedWord[channel] = word;
+    staged |= 1 << channel;
+  }
 
-    MSB |= 0x10; //get out of shutdown mode to active state
+  /**
+   * Sends the staged words back to back and, with DAC_LDAC_LATCH, pulses
+   * LDAC once, so all staged channels change on the same sample
+   */
+  void latch()
+  {
+    if (!staged)
+      return;
 
-    //now write to DAC
-    digitalWrite(DAC_CS, LOW); // take the CS pin low to select the chip:
-    SPI.transfer(MSB);         //  send in the address and value via SPI:
-    SPI.transfer(LSB);
-    digitalWrite(DAC_CS, HIGH); // take the CS pin high to de-select the chip:
+    for (uint8_t channel = 0; channel < 2; channel++)
+    {
+      if (staged & (1 << channel))
+      {
+        transfer(stagedWord[channel]);
+        lastWord[channel] = stagedWord[channel];
+        writesIssued++;
+      }
+    }
+    pulseLatch();
+    staged = 0;
   }
+
+  /** makes the next write to each channel go out even if unchanged */
+  void invalidate() { lastWord[0] = lastWord[1] = DAC_NO_WORD; }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -54,6 +54,7 @@ public:
 
         visible = true;
         _didClose = false;
+        ShiftRegisterPWM::singleton->showOverlay(displayData, flashData);
     }
 
     void hide()
@@ -63,7 +64,7 @@ public:
             visible = false;
             _didClose = true;
         }
-        ShiftRegisterPWM::singleton->clearSequenceLights();
+        ShiftRegisterPWM::singleton->hideOverlay();
     }
 
     void update()
@@ -80,8 +81,6 @@ public:
         this->high = high;
         this->timed = timed;
 
-        ShiftRegisterPWM::singleton->clearSequenceLights();
-
         bufferDisplay();
         show();
     }
@@ -112,14 +111,6 @@ public:
                 bitSet(displayData, i + offset);
     }
 
-    void writeoutDisplayBuffer(uint32_t *uiData, uint32_t *uiFlashData)
-    {
-        *uiData &= (uint32_t)0xFFFF0000;
-        *uiFlashData &= (uint32_t)0xFFFF0000;
-        *uiData |= displayData;
-        *uiFlashData |= flashData;
-    }
-
     bool didClose()
     {
         if (_didClose)
@@ -1,14 +1,70 @@
 #ifndef MY_GLIDE
 #define MY_GLIDE
 
-const uint8_t CURVE_RESOLUTION = 30;
-
-const uint16_t curveDataAx[CURVE_RESOLUTION] PROGMEM = {158, 312, 462, 608, 750, 888, 1022, 1152, 1278, 1400, 1518, 1632, 1742, 1848, 1950, 2048, 2142, 2232, 2318, 2400, 2478, 2552, 2622, 2688, 2750, 2808, 2862, 2912, 2958, 3000};
-const uint16_t curveDataAy[CURVE_RESOLUTION] PROGMEM = {1, 3, 5, 6, 8, 10, 13, 15, 17, 20, 23, 26, 29, 32, 35, 38, 42, 46, 49, 53, 57, 62, 66, 70, 75, 80, 85, 90, 95, 100};
-const uint16_t curveDataBx[CURVE_RESOLUTION] PROGMEM = {42, 88, 138, 192, 250, 312, 378, 448, 522, 600, 682, 768, 858, 952, 1050, 1152, 1258, 1368, 1482, 1600, 1722, 1848, 1978, 2112, 2250, 2392, 2538, 2688, 2842, 3000};
-const uint16_t curveDataBy[CURVE_RESOLUTION] PROGMEM = {5, 10, 15, 20, 25, 30, 34, 38, 43, 47, 51, 54, 58, 62, 65, 68, 71, 74, 77, 80, 83, 85, 87, 90, 92, 94, 95, 97, 99, 100};
-const uint16_t curveDataCx[CURVE_RESOLUTION] PROGMEM = {1, 200, 300, 400, 500, 600, 700, 800, 900, 1000, 1100, 1200, 1300, 1400, 1500, 1600, 1700, 1800, 1900, 2000, 2100, 2200, 2300, 2400, 2500, 2600, 2700, 2800, 2900, 3000};
-const uint16_t curveDataCy[CURVE_RESOLUTION] PROGMEM = {3, 7, 10, 13, 17, 20, 23, 27, 30, 33, 37, 40, 43, 47, 50, 53, 57, 60, 63, 67, 70, 73, 77, 80, 83, 87, 90, 93, 97, 100};
+#include <util/atomic.h>
+
+const uint16_t GLIDE_LUT_SIZE = 256; // samples per curve, indexed by the top 8 bits of the glide phase
+
+/*
+ * Glide curves as Q16 fractions of the pitch range (65535 = arrived), sampled
+ * evenly over the glide time. They are the smoothstep splines through the
+ * control points kept in tools/glide_lut.py; regenerate them there.
+ */
+// generated by tools/glide_lut.py, do not edit
+const uint16_t glideCurveA[GLIDE_LUT_SIZE] PROGMEM = {
+      655,   655,   655,   655,   655,   655,   655,   655,   655,   655,   655,   655,   655,   655,   661,   704,
+      781,   887,  1014,  1154,  1303,  1451,  1593,  1722,  1830,  1911,  1957,  1969,  2008,  2085,  2191,  2321,
+     2465,  2618,  2770,  2915,  3046,  3154,  3232,  3273,  3281,  3306,  3349,  3408,  3477,  3553,  3632,  3709,
+     3781,  3843,  3892,  3923,  3932,  3963,  4038,  4148,  4283,  4436,  4597,  4757,  4909,  5042,  5147,  5217,
+     5243,  5270,  5343,  5455,  5594,  5751,  5917,  6082,  6236,  6369,  6473,  6537,  6556,  6616,  6748,  6934,
+     7160,  7410,  7667,  7916,  8142,  8328,  8458,  8518,  8539,  8611,  8726,  8874,  9042,  9218,  9391,  9551,
+     9684,  9780,  9827,  9846,  9918, 10036, 10188, 10362, 10544, 10722, 10883, 11016, 11106, 11141, 11187, 11321,
+    11524, 11774, 12050, 12332, 12598, 12828, 13001, 13096, 13123, 13230, 13418, 13663, 13944, 14236, 14516, 14762,
+    14950, 15057, 15086, 15193, 15388, 15643, 15935, 16237, 16524, 16769, 16948, 17035, 17073, 17216, 17443, 17726,
+    18036, 18344, 18623, 18844, 18978, 19014, 19123, 19334, 19614, 19932, 20255, 20551, 20790, 20938, 20978, 21090,
+    21312, 21606, 21938, 22272, 22571, 22801, 22925, 22966, 23126, 23389, 23717, 24067, 24401, 24678, 24857, 24910,
+    25071, 25401, 25840, 26325, 26797, 27193, 27454, 27531, 27701, 28053, 28519, 29027, 29510, 29897, 30119, 30176,
+    30368, 30688, 31076, 31471, 31815, 32047, 32118, 32316, 32725, 33254, 33810, 34302, 34639, 34741, 34958, 35403,
+    35969, 36548, 37034, 37320, 37424, 37847, 38522, 39293, 40003, 40497, 40643, 40919, 41455, 42102, 42713, 43141,
+    43269, 43586, 44178, 44868, 45482, 45841, 46000, 46611, 47493, 48381, 49008, 49194, 49737, 50649, 51608, 52288,
+    52492, 53137, 54152, 55134, 55682, 55990, 56935, 58061, 58861, 59133, 60062, 61287, 62156, 62491, 63613, 64912,
+};
+const uint16_t glideCurveB[GLIDE_LUT_SIZE] PROGMEM = {
+     3277,  3277,  3277,  3277,  3379,  4248,  5473,  6402,  6674,  7474,  8600,  9545,  9853, 10401, 11383, 12398,
+    13043, 13247, 13927, 14886, 15798, 16341, 16527, 17154, 18042, 18924, 19535, 19694, 20053, 20667, 21357, 21949,
+    22266, 22394, 22822, 23433, 24080, 24616, 24892, 25038, 25532, 26242, 27013, 27688, 28111, 28215, 28501, 28987,
+    29566, 30132, 30577, 30794, 30896, 31233, 31725, 32281, 32810, 33219, 33417, 33488, 33720, 34064, 34459, 34847,
+    35167, 35359, 35416, 35638, 36025, 36508, 37016, 37482, 37834, 38004, 38081, 38342, 38738, 39210, 39695, 40134,
+    40464, 40625, 40678, 40857, 41134, 41468, 41818, 42146, 42409, 42569, 42610, 42734, 42964, 43263, 43597, 43929,
+    44223, 44445, 44557, 44597, 44745, 44984, 45280, 45603, 45921, 46201, 46412, 46521, 46557, 46691, 46912, 47191,
+    47499, 47809, 48092, 48319, 48462, 48500, 48587, 48766, 49011, 49298, 49600, 49892, 50147, 50342, 50449, 50478,
+    50585, 50773, 51019, 51299, 51591, 51872, 52117, 52305, 52412, 52439, 52534, 52707, 52937, 53203, 53485, 53761,
+    54011, 54214, 54348, 54394, 54429, 54519, 54652, 54813, 54991, 55173, 55347, 55499, 55617, 55689, 55708, 55755,
+    55851, 55984, 56144, 56317, 56493, 56661, 56809, 56924, 56996, 57017, 57077, 57207, 57393, 57619, 57868, 58125,
+    58375, 58601, 58787, 58919, 58979, 58998, 59062, 59166, 59299, 59453, 59618, 59784, 59941, 60080, 60192, 60265,
+    60292, 60318, 60388, 60493, 60626, 60778, 60938, 61099, 61252, 61387, 61497, 61572, 61603, 61612, 61643, 61692,
+    61754, 61826, 61903, 61982, 62058, 62127, 62186, 62229, 62254, 62262, 62303, 62381, 62489, 62620, 62765, 62917,
+    63070, 63214, 63344, 63450, 63527, 63566, 63578, 63624, 63705, 63813, 63942, 64084, 64232, 64381, 64521, 64648,
+    64754, 64831, 64874, 64882, 64902, 64938, 64988, 65049, 65117, 65188, 65261, 65331, 65396, 65452, 65496, 65525,
+};
+const uint16_t glideCurveC[GLIDE_LUT_SIZE] PROGMEM = {
+     1966,  1988,  2059,  2171,  2320,  2498,  2699,  2916,  3144,  3375,  3603,  3823,  4027,  4208,  4362,  4480,
+     4558,  4587,  4653,  4844,  5125,  5456,  5799,  6117,  6372,  6526,  6566,  6695,  6933,  7241,  7583,  7919,
+     8212,  8425,  8518,  8595,  8841,  9208,  9646, 10105, 10533, 10880, 11095, 11150, 11270, 11502, 11807, 12147,
+    12485, 12782, 13001, 13104, 13156, 13333, 13603, 13929, 14273, 14597, 14863, 15032, 15081, 15229, 15530, 15931,
+    16384, 16836, 17238, 17538, 17687, 17736, 17905, 18170, 18494, 18838, 19164, 19435, 19612, 19664, 19766, 19985,
+    20283, 20620, 20961, 21266, 21498, 21618, 21672, 21887, 22235, 22663, 23121, 23559, 23927, 24172, 24249, 24343,
+    24555, 24849, 25185, 25526, 25835, 26073, 26201, 26242, 26395, 26650, 26969, 27312, 27643, 27923, 28115, 28181,
+    28293, 28567, 28952, 29399, 29855, 30271, 30596, 30779, 30824, 30969, 31218, 31534, 31877, 32209, 32494, 32693,
+    32768, 32842, 33041, 33326, 33658, 34001, 34317, 34566, 34711, 34756, 34939, 35264, 35680, 36136, 36583, 36968,
+    37242, 37354, 37420, 37612, 37892, 38223, 38566, 38885, 39140, 39293, 39334, 39462, 39700, 40009, 40350, 40686,
+    40980, 41192, 41286, 41363, 41608, 41976, 42414, 42872, 43300, 43648, 43863, 43917, 44037, 44269, 44574, 44915,
+    45252, 45550, 45769, 45871, 45923, 46100, 46371, 46697, 47041, 47365, 47630, 47799, 47848, 47997, 48297, 48699,
+    49151, 49604, 50005, 50306, 50454, 50503, 50672, 50938, 51262, 51606, 51932, 52202, 52379, 52431, 52534, 52753,
+    53050, 53388, 53728, 54033, 54265, 54385, 54440, 54655, 55002, 55430, 55889, 56327, 56694, 56940, 57017, 57110,
+    57323, 57616, 57952, 58294, 58602, 58840, 58969, 59009, 59163, 59418, 59736, 60079, 60410, 60691, 60882, 60948,
+    61060, 61334, 61720, 62166, 62623, 63038, 63363, 63546, 63591, 63737, 63986, 64301, 64644, 64977, 65262, 65460,
+};
 
 class Glide
 {
@@ -23,117 +79,90 @@ public:
   };
   Glide() { this->setCurve(CURVE_B); }
 
-  void setCurve(CurveType curveType) { this->curveType = curveType; }
+  void setCurve(CurveType curveType)
+  {
+    const uint16_t *table;
+    switch (curveType)
+    {
+    case CURVE_A:
+      table = glideCurveA;
+      break;
+    case CURVE_B:
+      table = glideCurveB;
+      break;
+    case CURVE_C:
+      table = glideCurveC;
+      break;
+    default: // CURVE_D holds the initial pitch and jumps at the end of the glide
+      table = nullptr;
+      break;
+    }
+    this->curveType = curveType;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { curve = table; }
+  }
 
   void viewCurveData()
   {
-    for (uint8_t x = 0; x < 30; x++)
+    for (uint16_t x = 0; x < GLIDE_LUT_SIZE; x++)
     {
 #if (LOGGING)
-      Serial.print(curveDataAx[x]);
+      Serial.print(curve ? pgm_read_word_near(curve + x) : 0);
       Serial.print(",");
 #endif
     }
   }
 
-  void begin(uint16_t gate, float portoPercent, int pitch1, int pitch2)
+  /**
+   * Starts a glide between two pitches
+   * @param glideTime how long to glide for in ms, 0 jumps straight to pitch2
+   * @param pitch1 initial pitch
+   * @param pitch2 final pitch
+   */
+  void begin(uint16_t glideTime, int pitch1, int pitch2)
   {
-    this->pitch1 = pitch1;
-    this->pitch2 = pitch2;
-    this->startTime = millis();
+    // Q16 table index advanced per ms; elapsed * phaseStep stays below 2^24
+    uint32_t step = glideTime ? ((uint32_t)GLIDE_LUT_SIZE << 16) / glideTime : 0;
 
-    // setup timings
-    this->portamento = gate * portoPercent;
-    this->noteTime = gate - this->portamento;
-    this->glideScale = pitch2 - pitch1;
+    // getPitch() runs in the CV output interrupt, so swap the glide in at once
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      this->pitch1 = pitch1;
+      this->pitch2 = pitch2;
+      this->startTime = millis();
+      this->portamento = glideTime;
+      this->glideScale = pitch2 - pitch1;
+      this->phaseStep = step;
+    }
   }
 
+  /** current pitch of the glide, safe to call from an interrupt */
   int16_t getPitch()
   {
     if ((glideScale == 0) || (portamento == 0))
       return pitch2;
 
-    uint32_t now = millis();
-    uint32_t elapsed = now - startTime;
+    uint32_t elapsed = millis() - startTime;
 
-    if (elapsed <= portamento) // ---- gliding
+    if (elapsed < portamento) // ---- gliding
     {
-      float position = (float)elapsed / (float)portamento;
-      int16_t pitch = pitch1 + getPointAtX(position) * glideScale;
-      return pitch;
+      if (!curve)
+        return pitch1;
+      uint16_t position = pgm_read_word_near(curve + ((elapsed * phaseStep) >> 16));
+      return pitch1 + (int16_t)(((int32_t)glideScale * position) >> 16);
     }
     else // ---- glide complete
       return pitch2;
   }
 
-  double getPointAtX(double xPercent) { return SmoothStep(xPercent * CURVE_RESOLUTION); }
-
-  float getCurveX(uint8_t k)
-  {
-    switch (curveType)
-    {
-    case CURVE_A:
-      return pgm_read_word_near(curveDataAx + k) / 100.0;
-    case CURVE_B:
-      return pgm_read_word_near(curveDataBx + k) / 100.0;
-    case CURVE_C:
-      return pgm_read_word_near(curveDataCx + k) / 100.0;
-    case CURVE_D:
-      break;
-    }
-    return 0;
-  }
-
-  float getCurveY(uint8_t k)
-  {
-    switch (curveType)
-    {
-    case CURVE_A:
-      return pgm_read_word_near(curveDataAy + k) / 100.0;
-    case CURVE_B:
-      return pgm_read_word_near(curveDataBy + k) / 100.0;
-    case CURVE_C:
-      return pgm_read_word_near(curveDataCy + k) / 100.0;
-    case CURVE_D:
-      break;
-    }
-    return 0;
-  }
-
-  double SmoothStep(float pointX, bool trim = true)
-  {
-    if (trim)
-    {
-      if (pointX <= getCurveX(0))
-        return getCurveY(0);
-      if (pointX >= getCurveX(CURVE_RESOLUTION - 1))
-        return getCurveY(CURVE_RESOLUTION - 1);
-    }
-
-    auto i = 0;
-    if (pointX <= getCurveX(0))
-      i = 0;
-    else if (pointX >= getCurveX(CURVE_RESOLUTION - 1))
-      i = CURVE_RESOLUTION - 1;
-    else
-      while (pointX >= getCurveX(i + 1))
-        i++;
-    if (pointX == getCurveX(i + 1))
-      return getCurveY(i + 1);
-
-    auto t = (pointX - getCurveX(i)) / (getCurveX(i + 1) - getCurveX(i));
-    t = t * t * (3 - 2 * t);
-    return getCurveY(i) * (1 - t) + getCurveY(i + 1) * t;
-  }
-
 private:
   uint32_t startTime;  // when the note started playing
-  uint16_t noteTime;   // delay before starting glide
+  uint32_t phaseStep;  // Q16 curve table steps per ms
   uint16_t portamento; // how long to glide/bend for
   int16_t pitch1;      // initial pitch
   int16_t pitch2;      // final to pitch
   int16_t glideScale;  // pitch range
   CurveType curveType = CurveType::CURVE_B;
+  const uint16_t *curve = nullptr; // PROGMEM table of the current curve
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,14 +2,14 @@
 #define MY_KNOB_H 
 
 #include <Arduino.h>
-#include <AnalogMultiButton.h>
-#include <RotaryEncoder.h>
+#include "AdcScanner.h"
 #include "uistate.h"
 #include "ShiftRegisterPWM.h"
+#include "QuadratureDecoder.h"
 
 enum KnobFunction : uint8_t
 {
-  TempoAdjust = 16,
+  TempoAdjust = LED_STATUS, // a knob mode is also the pin of its LED
   StepSelect,
   GateTime,
   PlayMode,
@@ -20,6 +20,25 @@ enum KnobFunction : uint8_t
   Octave
 };
 
+// Acceleration: a detent turned KNOB_SLOW_MS or more after the previous one
+// is one step, one turned within KNOB_FAST_MS is the function's top
+// multiplier, and the multiplier rises with the square of the speed between
+const uint8_t KNOB_SLOW_MS = 60;
+const uint8_t KNOB_FAST_MS = 8;
+
+// top step multiplier per KnobFunction, 1 keeps every detent a single step
+const uint8_t knobAcceleration[] PROGMEM = {
+    16, // TempoAdjust, 20..500 BPM
+    1,  // StepSelect
+    1,  // GateTime
+    1,  // PlayMode
+    2,  // GlideTime
+    4,  // Pitch, transpose -24..24
+    2,  // NumSteps, also pattern and bank selection
+    1,  // GlideShape
+    1,  // Octave
+};
+
 struct KnobState
 {
   short pos = 0;
@@ -30,15 +49,37 @@ struct KnobState
 class Knob
 {
 private:
-  AnalogMultiButton *amButton;
-  RotaryEncoder *encoder;
+  ButtonLadder *amButton;
   KnobFunction *knobModes;
+  short position = 0; // detents counted from the decoder, kept inside the range
   uint8_t index = 0;
   uint8_t modeIndex = 0;
   uint8_t lastShiftState = 0;
   bool changed = false;
   short lastDirection = 0;
+  short lastSteps = 0;
+  uint32_t lastTurn = 0; // millis() of the last detent
   KnobState knobState[2][3];
+
+  /**
+   * Steps for the detents turned since the last update
+   * @param turned detents, clockwise positive
+   */
+  short accelerate(int8_t turned)
+  {
+    uint32_t now = millis();
+    uint8_t count = abs(turned);
+    uint32_t interval = (now - lastTurn) / count;
+    lastTurn = now;
+
+    uint8_t top = pgm_read_byte_near(knobAcceleration + knobModes[modeIndex] - TempoAdjust);
+    if (top <= 1 || interval >= KNOB_SLOW_MS)
+      return turned;
+
+    uint8_t speed = (interval <= KNOB_FAST_MS) ? 16 : (KNOB_SLOW_MS - interval) * 16 / (KNOB_SLOW_MS - KNOB_FAST_MS);
+    uint8_t multiplier = 1 + (((top - 1) * speed * speed) >> 8);
+    return turned * multiplier;
+  }
   
   uint8_t modeShift()
   {    
@@ -70,9 +111,12 @@ private:
 
 public:
 
-  Knob(uint8_t index, AnalogMultiButton amButton, uint8_t pin1, uint8_t pin2)
+  /**
+   * @param index the encoder, 0..2, see QuadratureDecoder for the pins
+   * @param amButton the ladder with the encoder push buttons
+   */
+  Knob(uint8_t index, ButtonLadder &amButton)
   {
-    encoder = new RotaryEncoder(pin2, pin1, RotaryEncoder::LatchMode::FOUR3);
     this->index = index;
     this->amButton = &amButton;
   }
@@ -89,7 +133,7 @@ public:
   {
     KnobState *k = getKnobState(modeIndex);
     short newPos = constrain(newValue, k->rangeMin, k->rangeMax);
-    encoder->setPosition(newPos);
+    position = newPos;
     k->pos = newPos;
   }
 
@@ -103,7 +147,7 @@ public:
   void setMode(uint8_t mode)
   {
     modeIndex = mode % 3;
-    encoder->setPosition(getKnobState(modeIndex)->pos);
+    position = getKnobState(modeIndex)->pos;
     setLED();
   }
   
@@ -135,20 +179,20 @@ public:
   void resetKnobState() {
     changed=false;
     KnobState *k = getKnobState(modeIndex);
-    k->pos = constrain(encoder->getPosition(), k->rangeMin, k->rangeMax);
-    lastDirection = (short)encoder->getDirection();    
+    k->pos = constrain(position, k->rangeMin, k->rangeMax);
+    lastDirection = 0;
   }
 
   void update()
   {
-    encoder->tick();
+    int8_t turned = QuadratureDecoder::singleton->take(index);
+    lastSteps = turned ? accelerate(turned) : 0;
+    position += lastSteps;
     changed = false;
     KnobState *k = getKnobState(modeIndex);
-    short newPos = constrain(encoder->getPosition(), k->rangeMin, k->rangeMax);
-    lastDirection = (short)encoder->getDirection();
-
-    if (newPos != encoder->getPosition())    
-      encoder->setPosition(newPos);    
+    short newPos = constrain(position, k->rangeMin, k->rangeMax);
+    lastDirection = (turned > 0) - (turned < 0);
+    position = newPos;
 
     if (k->pos != newPos)
     {
@@ -158,6 +202,8 @@ public:
   }
 
   short direction() { return lastDirection; }
+  /** steps of the last update, the detents times the acceleration */
+  short steps() { return lastSteps; }
   bool onPress() { return amButton->onPress(this->index - 1); }
 
   bool didChange()
@@ -0,0 +1,104 @@
+#ifndef ANALOG_MULTI_BUTTON_H
+#define ANALOG_MULTI_BUTTON_H
+
+#include "Arduino.h"
+
+/*
+ * Same interface and press semantics as the AnalogMultiButton library,
+ * reading the ladder voltage from the simulated ADC.
+ */
+class AnalogMultiButton
+{
+private:
+    int pin;
+    int total;
+    const int *values;
+    unsigned int debounceDuration;
+    unsigned int analogResolution;
+
+    int buttonPressed = -1;
+    int buttonOnPress = -1;
+    int buttonOnRelease = -1;
+    int buttonPressedBefore = -1;
+    int lastDebounceButton = -1;
+    int pressAfterFired = -1;
+    uint32_t debounceStart = 0;
+    uint32_t pressStart = 0;
+    uint32_t releasedDuration = 0;
+
+    int getButtonForAnalogValue(int value)
+    {
+        for (int i = 0; i < total; i++)
+        {
+            int upper = (i + 1 < total) ? (values[i] + values[i + 1]) / 2 : (values[i] + (int)analogResolution) / 2;
+            if (value <= upper)
+                return i;
+        }
+        return -1;
+    }
+
+public:
+    AnalogMultiButton(int pin, int total, const int values[], unsigned int debounceDuration = 20, unsigned int analogResolution = 1024)
+        : pin(pin), total(total), values(values), debounceDuration(debounceDuration), analogResolution(analogResolution) {}
+
+    void update()
+    {
+        buttonOnPress = -1;
+        buttonOnRelease = -1;
+        uint32_t now = millis();
+        int button = getButtonForAnalogValue(analogRead(pin));
+
+        if (button != lastDebounceButton)
+        {
+            lastDebounceButton = button;
+            debounceStart = now;
+        }
+        if (now - debounceStart < debounceDuration || button == buttonPressed)
+            return;
+
+        if (buttonPressed != -1)
+        {
+            buttonOnRelease = buttonPressed;
+            releasedDuration = now - pressStart;
+        }
+        buttonPressedBefore = buttonPressed;
+        buttonPressed = button;
+        if (button != -1)
+        {
+            buttonOnPress = button;
+            pressStart = now;
+        }
+    }
+
+    bool isPressed(int button) { return buttonPressed == button; }
+    bool onPress(int button) { return buttonOnPress == button; }
+    bool onRelease(int button) { return buttonOnRelease == button; }
+
+    bool onPressAfter(int button, int duration)
+    {
+        if (!isPressed(button))
+            return false;
+        if (onPress(button))
+            pressAfterFired = -1;
+        if (pressAfterFired != button && millis() - pressStart >= (uint32_t)duration)
+        {
+            pressAfterFired = button;
+            return true;
+        }
+        return false;
+    }
+
+    bool onReleaseBefore(int button, int duration)
+    {
+        return onRelease(button) && releasedDuration < (uint32_t)duration;
+    }
+
+    bool onReleaseAfter(int button, int duration)
+    {
+        return onRelease(button) && releasedDuration >= (uint32_t)duration;
+    }
+
+    unsigned long getPressDuration() { return buttonPressed == -1 ? 0 : millis() - pressStart; }
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+const uint16_t SIM_EEPROM_SIZE = 1024;
+
+/*
+ * 1 KB EEPROM image. Each write busy-waits for the simulated programming
+ * time (3.4 ms by default, see simSetEepromWriteTime) exactly like
+ * eeprom_write_byte() does on the ATmega328P, so ISRs keep firing while
+ * the main loop is stalled.
+ */
+class EEPROMClass
+{
+public:
+    uint8_t data[SIM_EEPROM_SIZE];
+
+    EEPROMClass() { memset(data, 0xFF, sizeof(data)); }
+
+    uint8_t read(int idx); // waits for an EECR write in progress, like eeprom_read_byte()
+    void write(int idx, uint8_t val);
+    void update(int idx, uint8_t val)
+    {
+        if (read(idx) != val)
+            write(idx, val);
+    }
+    uint16_t length() { return SIM_EEPROM_SIZE; }
+
+    template <typename T>
+    T &get(int idx, T &t)
+    {
+        memcpy(&t, data + idx, sizeof(T));
+        return t;
+    }
+
+    template <typename T>
+    const T &put(int idx, const T &t)
+    {
+        const uint8_t *ptr = (const uint8_t *)&t;
+        for (uint16_t i = 0; i < sizeof(T); i++)
+            update(idx + i, ptr[i]);
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef MEMORY_FREE_H
+#define MEMORY_FREE_H
+
+// The AVR heap/stack probe has no meaning on the host, so this always returns 0.
+int freeMemory();
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef ROTARY_ENCODER_H
+#define ROTARY_ENCODER_H
+
+#include "Arduino.h"
+
+/*
+ * Same interface and quadrature state machine as the RotaryEncoder library,
+ * sampling the simulated input pins.
+ */
+class RotaryEncoder
+{
+public:
+    enum class Direction
+    {
+        NOROTATION = 0,
+        CLOCKWISE = 1,
+        COUNTERCLOCKWISE = -1
+    };
+
+    enum class LatchMode
+    {
+        FOUR3 = 1,
+        FOUR0 = 2,
+        TWO03 = 3
+    };
+
+    RotaryEncoder(int pin1, int pin2, LatchMode mode = LatchMode::FOUR0)
+        : pin1(pin1), pin2(pin2), mode(mode)
+    {
+        pinMode(pin1, INPUT_PULLUP);
+        pinMode(pin2, INPUT_PULLUP);
+        oldState = digitalRead(pin1) | (digitalRead(pin2) << 1);
+    }
+
+    long getPosition() { return positionExt; }
+
+    Direction getDirection()
+    {
+        Direction ret = Direction::NOROTATION;
+        if (positionExtPrev > positionExt)
+            ret = Direction::COUNTERCLOCKWISE;
+        else if (positionExtPrev < positionExt)
+            ret = Direction::CLOCKWISE;
+        positionExtPrev = positionExt;
+        return ret;
+    }
+
+    void setPosition(long newPosition)
+    {
+        switch (mode)
+        {
+        case LatchMode::FOUR3:
+        case LatchMode::FOUR0:
+            position = ((newPosition << 2) | (position & 0x03L));
+            break;
+        case LatchMode::TWO03:
+            position = ((newPosition << 1) | (position & 0x01L));
+            break;
+        }
+        positionExt = newPosition;
+        positionExtPrev = newPosition;
+    }
+
+    void tick()
+    {
+        static const int8_t KNOBDIR[] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+        int8_t thisState = digitalRead(pin1) | (digitalRead(pin2) << 1);
+        if (oldState == thisState)
+            return;
+
+        position += KNOBDIR[thisState | (oldState << 2)];
+        oldState = thisState;
+
+        switch (mode)
+        {
+        case LatchMode::FOUR3:
+            if (thisState == 3)
+                positionExt = position >> 2;
+            break;
+        case LatchMode::FOUR0:
+            if (thisState == 0)
+                positionExt = position >> 2;
+            break;
+        case LatchMode::TWO03:
+            if (thisState == 0 || thisState == 3)
+                positionExt = position >> 1;
+            break;
+        }
+    }
+
+private:
+    int pin1, pin2;
+    LatchMode mode;
+    int8_t oldState;
+    long position = 0;
+    long positionExt = 0;
+    long positionExtPrev = 0;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <stdint.h>
+
+#define SPI_MODE0 0x00
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+struct SPISettings
+{
+    SPISettings() {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+/*
+ * Bytes clocked out while the DAC chip select (D10) is low are decoded as
+ * MCP4822 command words and reported in simStats.
+ */
+class SPIClass
+{
+public:
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    void setClockDivider(uint8_t) {}
+    uint8_t transfer(uint8_t data);
+    uint16_t transfer16(uint16_t data)
+    {
+        uint16_t hi = transfer(data >> 8);
+        return (hi << 8) | transfer(data & 0xFF);
+    }
+};
+
+extern SPIClass SPI;
+
+#endif
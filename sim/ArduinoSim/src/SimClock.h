@@ -0,0 +1,84 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <stdint.h>
+
+/*
+ * Virtual time source for the host-native build.
+ *
+ * Time only moves when the simulation asks it to: simAdvance() walks the
+ * pending hardware events (timer compare matches, external clock edges,
+ * scripted button presses) in order and calls the matching ISRs at their
+ * exact virtual time. Code running between two simAdvance() calls takes no
+ * virtual time at all, so the main loop cost is modelled explicitly by the
+ * driver.
+ */
+
+const uint32_t SIM_F_CPU = 16000000UL;          // ticks per virtual second
+const uint32_t SIM_TICKS_PER_US = SIM_F_CPU / 1000000UL;
+
+// in AVR vector priority order
+enum SimIsr : uint8_t
+{
+    SIM_ISR_TIMER2_COMPA,
+    SIM_ISR_TIMER1_COMPA,
+    SIM_ISR_INT0,
+    SIM_ISR_PCINT0,
+    SIM_ISR_PCINT1,
+    SIM_ISR_ADC,
+    SIM_ISR_EE_READY,
+    SIM_ISR_COUNT
+};
+
+extern const char *const simIsrNames[SIM_ISR_COUNT];
+
+struct SimStats
+{
+    uint64_t loops = 0;          // loop() iterations (counted by the driver)
+    uint64_t isrCalls[SIM_ISR_COUNT] = {};
+    uint64_t isrHostNs[SIM_ISR_COUNT] = {}; // host time spent inside each ISR
+    uint64_t eepromWrites = 0;   // EEPROM.write/update cycles that changed a cell, and EECR writes
+    uint64_t eepromReadStalls = 0; // EEPROM.read calls that waited for a write in progress
+    uint64_t dacWrites[2] = {0, 0}; // command words received per channel
+    uint16_t dacValue[2] = {0, 0};  // channel outputs, updated when LDAC is low or falls
+    uint64_t dacLatches = 0;        // LDAC falling edges
+    uint64_t hostLoopNs = 0;     // host time spent inside loop()
+
+    // outputs observed on the emulated 74HC595 chain
+    uint32_t srOutputs = 0;
+    uint64_t srOnTicks[32] = {}; // time each output spent high, counted up to the last latch
+    uint64_t srLastLatch = 0;    // ticks
+    uint64_t clockEdges = 0;
+    uint64_t firstClockEdge = 0; // ticks
+    uint64_t lastClockEdge = 0;  // ticks
+    uint64_t minClockPeriod = 0; // ticks
+    uint64_t maxClockPeriod = 0; // ticks
+    uint64_t gateEdges = 0;
+};
+
+extern SimStats simStats;
+
+uint64_t simTicks();                       // current virtual time in 16 MHz ticks
+void simAdvance(uint32_t microseconds);    // move virtual time forward, firing ISRs
+void simAdvanceTicks(uint64_t ticks);
+
+// stimulus
+void simSetAnalog(uint8_t pin, int value); // value returned by analogRead(pin)
+void simPressAnalog(uint8_t pin, int value, uint32_t atMs, uint32_t forMs);
+void simSetPin(uint8_t pin, uint8_t level); // drive an input pin
+void simExternalClock(float bpm, uint32_t jitterUs = 0, uint32_t pulseUs = 5000);
+
+// what the Arduino core's init() does between the global constructors and
+// setup() that the sketch can notice: USART0 is turned off
+void simInit();
+
+// knobs for the engine itself
+void simSetTimer1Decimation(uint16_t n);   // call the LED ISR every n-th compare match
+void simSetTimer1Latency(uint32_t ticks);  // enter the LED ISR late, as if another ISR held it off
+void simSetSerialEcho(bool echo);
+void simSetEepromWriteTime(uint32_t microseconds);
+bool simLoadEeprom(const char *path);
+bool simSaveEeprom(const char *path);
+void simSeedEeprom();                      // the demo pattern in every slot of the old flat layout
+
+#endif
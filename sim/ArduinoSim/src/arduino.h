@@ -0,0 +1,2 @@
+// case-insensitive spelling used by some sketches
+#include "Arduino.h"
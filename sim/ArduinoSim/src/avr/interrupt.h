@@ -0,0 +1,24 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include "io.h"
+
+// Vector names map onto plain C functions the virtual clock calls directly.
+#define TIMER1_COMPA_vect sim_isr_TIMER1_COMPA
+#define TIMER2_COMPA_vect sim_isr_TIMER2_COMPA
+#define PCINT0_vect sim_isr_PCINT0
+#define PCINT1_vect sim_isr_PCINT1
+#define ADC_vect sim_isr_ADC
+#define EE_READY_vect sim_isr_EE_READY
+
+#define ISR(vector, ...)           \
+    extern "C" void vector(void);  \
+    extern "C" void vector(void)
+
+void sim_cli();
+void sim_sei();
+
+#define cli() sim_cli()
+#define sei() sim_sei()
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+/*
+ * ATmega328P register stand-ins. Port registers are small proxy objects so
+ * the simulation can watch pin changes (74HC595 chain, DAC chip select);
+ * everything else is plain memory that the virtual clock reads back.
+ */
+
+class SimPort
+{
+private:
+    uint8_t id;
+    uint8_t value = 0;
+    void write(uint8_t v);
+
+public:
+    explicit SimPort(uint8_t id) : id(id) {}
+    operator uint8_t() const { return value; }
+    SimPort &operator=(int v) { write(v); return *this; }
+    SimPort &operator|=(int v) { write(value | v); return *this; }
+    SimPort &operator&=(int v) { write(value & v); return *this; }
+    SimPort &operator^=(int v) { write(value ^ v); return *this; }
+};
+
+extern SimPort PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t PINB, PINC, PIND; // follow simSetPin()
+
+// pin change interrupts: PCINT0 covers PORTB, PCINT1 PORTC
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+
+extern volatile uint8_t SREG;
+
+// Timer/Counter1 counts virtual time up to OCR1A, in CTC mode (WGM12) or in
+// fast PWM with TOP = OCR1A (WGM13:10 all set). In CTC mode OCR1A changes at
+// once, so a value the counter has already passed is missed and the counter
+// runs on to 0xFFFF; in fast PWM it is double buffered and taken over at
+// BOTTOM.
+class SimTimer1Count
+{
+public:
+    operator uint16_t() const;
+    SimTimer1Count &operator=(uint16_t v);
+};
+
+class SimTimer1Compare
+{
+public:
+    operator uint16_t() const;
+    SimTimer1Compare &operator=(uint16_t v);
+};
+
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern SimTimer1Count TCNT1;
+extern SimTimer1Compare OCR1A;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define OCIE1A 1
+
+// Timer/Counter2
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+
+// SPI: a byte written to SPDR is clocked out at once, so SPIF always reads set
+class SimSpiData
+{
+public:
+    SimSpiData &operator=(uint8_t v);
+    operator uint8_t() const { return 0; }
+};
+
+extern SimSpiData SPDR;
+extern volatile uint8_t SPCR, SPSR;
+
+#define SPIF 7
+
+// USART0, Master SPI mode only: a byte written to UDR0 is clocked out at
+// once, so UDRE0 and TXC0 always read set
+class SimUsartData
+{
+public:
+    SimUsartData &operator=(uint8_t v);
+    operator uint8_t() const { return 0; }
+};
+
+// status flags: transfers are instant, so the buffer is always empty and done
+class SimUsartStatus
+{
+public:
+    SimUsartStatus &operator=(uint8_t) { return *this; }
+    operator uint8_t() const { return 0x60; } // UDRE0 | TXC0
+};
+
+extern SimUsartData UDR0;
+extern SimUsartStatus UCSR0A;
+extern volatile uint8_t UCSR0B, UCSR0C;
+extern volatile uint16_t UBRR0;
+
+#define UCPOL0 0
+#define UCPHA0 1
+#define UDORD0 2
+#define TXEN0 3
+#define UDRE0 5
+#define TXC0 6
+#define UMSEL00 6
+#define UMSEL01 7
+
+// ADC: in free running mode a conversion completes every 13 ADC clocks, the
+// result is the channel ADMUX selected when that conversion started
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+extern volatile uint16_t ADC;
+
+#define MUX0 0
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define ADTS0 0
+
+// EEPROM: a write started with EEMPE then EEPE takes the simulated programming
+// time (see simSetEepromWriteTime); EE_READY is raised when it ends and when
+// EERIE is set while no write runs. Each read of EECR during a write takes a
+// microsecond, so polling EEPE moves virtual time on.
+class SimEepromControl
+{
+private:
+    uint8_t value = 0;
+    void write(uint8_t v);
+
+public:
+    operator uint8_t() const;
+    SimEepromControl &operator=(int v) { write(v); return *this; }
+    SimEepromControl &operator|=(int v) { write(value | v); return *this; }
+    SimEepromControl &operator&=(int v) { write(value & v); return *this; }
+};
+
+extern SimEepromControl EECR;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t EEDR;
+
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+#define E2END 0x3FF
+
+#define _BV(bit) (1 << (bit))
+
+#endif
@@ -0,0 +1,713 @@
+#include <chrono>
+#include <stdarg.h>
+
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "SPI.h"
+#include "MemoryFree.h"
+
+// ISRs are provided by the sketch; the ones it does not define stay null.
+extern "C" void sim_isr_TIMER1_COMPA(void) __attribute__((weak));
+extern "C" void sim_isr_TIMER2_COMPA(void) __attribute__((weak));
+extern "C" void sim_isr_PCINT0(void) __attribute__((weak));
+extern "C" void sim_isr_PCINT1(void) __attribute__((weak));
+extern "C" void sim_isr_ADC(void) __attribute__((weak));
+extern "C" void sim_isr_EE_READY(void) __attribute__((weak));
+
+SimStats simStats;
+const char *const simIsrNames[SIM_ISR_COUNT] = {"TIMER2_COMPA", "TIMER1_COMPA", "INT0", "PCINT0", "PCINT1", "ADC", "EE_READY"};
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+SPIClass SPI;
+
+SimPort PORTB(1), PORTC(2), PORTD(3);
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t PINB = 0xFF, PINC = 0xFF, PIND = 0xFF;
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t SREG = 0x80;
+SimSpiData SPDR;
+volatile uint8_t SPCR, SPSR = _BV(SPIF);
+SimUsartData UDR0;
+SimUsartStatus UCSR0A;
+volatile uint8_t UCSR0B, UCSR0C;
+volatile uint16_t UBRR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+SimTimer1Count TCNT1;
+SimTimer1Compare OCR1A;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+volatile uint16_t ADC;
+SimEepromControl EECR;
+volatile uint16_t EEAR;
+volatile uint8_t EEDR;
+
+namespace
+{
+const uint8_t OUT_CLOCK_BIT = 29; // outClock on the 74HC595 chain
+const uint8_t OUT_GATE_BIT = 30;  // outGate
+
+uint64_t now = 0; // virtual ticks
+
+bool pending[SIM_ISR_COUNT];
+
+// CTC timers, following whatever the sketch last wrote into their registers
+struct CompareTimer
+{
+    SimIsr isr;
+    uint64_t (*period)(); // 0 while stopped
+    uint64_t currentPeriod;
+    uint64_t next;
+    uint16_t decimation;
+    uint16_t skip;
+};
+
+uint64_t timer2Period()
+{
+    if (!(TIMSK2 & _BV(OCIE2A)) || !(TCCR2A & _BV(WGM21)))
+        return 0;
+    static const uint16_t prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+    return (uint64_t)prescalers[TCCR2B & 0x07] * (OCR2A + 1);
+}
+
+// the ADC in free running mode, treated as one more periodic source
+uint64_t adcPeriod()
+{
+    const uint8_t running = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE);
+    if ((ADCSRA & running) != running || (ADCSRB & 0x07))
+        return 0;
+    uint8_t prescale = ADCSRA & 0x07;
+    return (uint64_t)13 << (prescale ? prescale : 1);
+}
+
+CompareTimer timers[] = {
+    {SIM_ISR_TIMER2_COMPA, timer2Period, 0, 0, 1, 0},
+    {SIM_ISR_ADC, adcPeriod, 0, 0, 1, 0},
+};
+const uint8_t TIMER_COUNT = sizeof(timers) / sizeof(timers[0]);
+
+// Timer1 counts from timer1Bottom, so a late ISR sees how far it got
+uint64_t timer1Bottom = 0;   // when TCNT1 was last 0
+uint16_t timer1Stopped = 0;  // TCNT1 while no clock is selected
+uint16_t timer1Top = 0;      // OCR1A as the compare unit sees it
+uint16_t timer1Buffer = 0;   // OCR1A as last written
+bool timer1Held = false;     // a compare match waits for its ISR
+uint64_t timer1IsrAt = 0;    // when that ISR is entered
+uint32_t timer1Latency = 0;  // ticks from a compare match to its ISR
+uint16_t timer1Decimation = 1;
+uint16_t timer1Skip = 0;
+
+uint16_t timer1Prescaler()
+{
+    static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return prescalers[TCCR1B & 0x07];
+}
+
+// mode 15, fast PWM with TOP = OCR1A, double buffers OCR1A
+bool timer1FastPwm()
+{
+    const uint8_t low = _BV(WGM11) | _BV(WGM10);
+    return (TCCR1B & _BV(WGM13)) && (TCCR1A & low) == low;
+}
+
+// when TCNT1 next goes back to 0, 0 while it does not count up to OCR1A;
+// compare tells whether it gets there through a compare match or by
+// running past 0xFFFF
+uint64_t timer1Wrap(bool &compare)
+{
+    uint16_t prescaler = timer1Prescaler();
+    if (!prescaler || !(TCCR1B & _BV(WGM12)))
+        return 0;
+    compare = (now - timer1Bottom) / prescaler <= timer1Top;
+    return timer1Bottom + (uint64_t)((compare ? timer1Top : 0xFFFF) + 1) * prescaler;
+}
+
+// external clock on INT0 (D2)
+void (*int0Callback)(void) = nullptr;
+int int0Mode = 0;
+uint64_t extClockPeriod = 0;
+uint64_t extClockIdeal = 0;
+uint64_t extClockNext = 0;
+uint64_t extClockRelease = 0;
+uint32_t extClockJitter = 0;
+uint32_t extClockPulse = 0;
+
+// analog button stimulus
+int analogLevel[8] = {1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023};
+uint8_t adcChannel = 0; // channel of the conversion in progress
+struct AnalogPress
+{
+    uint8_t channel;
+    int value;
+    uint64_t at;
+    uint64_t release;
+};
+const uint8_t MAX_PRESSES = 16;
+AnalogPress presses[MAX_PRESSES];
+uint8_t pressCount = 0;
+
+// emulated 74HC595 chain
+uint32_t srShift = 0;
+
+// emulated MCP4822
+bool dacSelected = false;
+uint8_t dacFrame[2];
+uint8_t dacFrameLength = 0;
+uint16_t dacInput[2] = {0, 0}; // input registers, moved to the outputs by LDAC
+
+bool serialEcho = false;
+uint32_t eepromWriteUs = 3400;
+uint64_t eepromDone = 0; // end of the EECR write in progress, 0 when idle
+uint16_t eepromAddress;
+uint8_t eepromValue;
+
+uint8_t inputLevel[3] = {0xFF, 0xFF, 0xFF};
+
+SimPort *portFor(uint8_t pin, uint8_t &mask)
+{
+    if (pin < 8)
+    {
+        mask = 1 << pin;
+        return &PORTD;
+    }
+    if (pin < 14)
+    {
+        mask = 1 << (pin - 8);
+        return &PORTB;
+    }
+    mask = 1 << (pin - 14);
+    return &PORTC;
+}
+
+void (*vector(SimIsr which))(void)
+{
+    switch (which)
+    {
+    case SIM_ISR_TIMER2_COMPA:
+        return sim_isr_TIMER2_COMPA;
+    case SIM_ISR_TIMER1_COMPA:
+        return sim_isr_TIMER1_COMPA;
+    case SIM_ISR_INT0:
+        return int0Callback;
+    case SIM_ISR_PCINT0:
+        return (PCICR & _BV(PCIE0)) ? sim_isr_PCINT0 : nullptr;
+    case SIM_ISR_PCINT1:
+        return (PCICR & _BV(PCIE1)) ? sim_isr_PCINT1 : nullptr;
+    case SIM_ISR_ADC:
+        return sim_isr_ADC;
+    case SIM_ISR_EE_READY:
+        return (EECR & _BV(EERIE)) ? sim_isr_EE_READY : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+void callIsr(SimIsr which)
+{
+    auto start = std::chrono::steady_clock::now();
+    vector(which)();
+    simStats.isrHostNs[which] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    simStats.isrCalls[which]++;
+}
+
+// raises an interrupt; it is held pending while interrupts are disabled
+void raise(SimIsr which)
+{
+    if (!vector(which))
+        return;
+    if (!(SREG & 0x80))
+        pending[which] = true;
+    else
+        callIsr(which);
+}
+
+void latchShiftRegisters()
+{
+    uint32_t previous = simStats.srOutputs;
+    simStats.srOutputs = srShift;
+
+    uint64_t shown = now - simStats.srLastLatch;
+    for (uint8_t bit = 0; bit < 32; bit++)
+        if (bitRead(previous, bit))
+            simStats.srOnTicks[bit] += shown;
+    simStats.srLastLatch = now;
+
+    if (!bitRead(previous, OUT_CLOCK_BIT) && bitRead(srShift, OUT_CLOCK_BIT))
+    {
+        if (simStats.clockEdges > 0)
+        {
+            uint64_t period = now - simStats.lastClockEdge;
+            if (simStats.clockEdges == 1 || period < simStats.minClockPeriod)
+                simStats.minClockPeriod = period;
+            if (period > simStats.maxClockPeriod)
+                simStats.maxClockPeriod = period;
+        }
+        else
+            simStats.firstClockEdge = now;
+        simStats.lastClockEdge = now;
+        simStats.clockEdges++;
+    }
+
+    if (!bitRead(previous, OUT_GATE_BIT) && bitRead(srShift, OUT_GATE_BIT))
+        simStats.gateEdges++;
+}
+
+void decodeDacFrame()
+{
+    if (dacFrameLength != 2)
+        return;
+    uint16_t word = (dacFrame[0] << 8) | dacFrame[1];
+    uint8_t channel = word >> 15;
+    simStats.dacWrites[channel]++;
+    dacInput[channel] = word & 0x0FFF;
+    if (!(PORTD & 0b10000000)) // LDAC (D7) held low: the output follows at once
+        simStats.dacValue[channel] = dacInput[channel];
+}
+} // namespace
+
+void SimPort::write(uint8_t v)
+{
+    uint8_t rising = ~value & v;
+    uint8_t falling = value & ~v;
+    value = v;
+
+    if (id == 3) // PORTD: D4 data, D5 latch, D6 clock of the 74HC595 chain, D7 DAC LDAC
+    {
+        if (rising & 0b01000000)
+            srShift = (srShift << 1) | ((v & 0b00010000) ? 1 : 0);
+        if (rising & 0b00100000)
+            latchShiftRegisters();
+        if (falling & 0b10000000) // D7 is the DAC LDAC
+        {
+            simStats.dacValue[0] = dacInput[0];
+            simStats.dacValue[1] = dacInput[1];
+            simStats.dacLatches++;
+        }
+    }
+    else if (id == 1) // PORTB: D10 is the DAC chip select
+    {
+        if (falling & 0b00000100)
+        {
+            dacSelected = true;
+            dacFrameLength = 0;
+        }
+        if (rising & 0b00000100)
+        {
+            dacSelected = false;
+            decodeDacFrame();
+        }
+    }
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    if (dacSelected && dacFrameLength < sizeof(dacFrame))
+        dacFrame[dacFrameLength++] = data;
+    return 0;
+}
+
+SimTimer1Count::operator uint16_t() const
+{
+    uint16_t prescaler = timer1Prescaler();
+    return prescaler ? (now - timer1Bottom) / prescaler : timer1Stopped;
+}
+
+SimTimer1Count &SimTimer1Count::operator=(uint16_t v)
+{
+    uint16_t prescaler = timer1Prescaler();
+    timer1Stopped = v;
+    timer1Bottom = now - (uint64_t)v * (prescaler ? prescaler : 1);
+    return *this;
+}
+
+SimTimer1Compare::operator uint16_t() const { return timer1Buffer; }
+
+SimTimer1Compare &SimTimer1Compare::operator=(uint16_t v)
+{
+    timer1Buffer = v;
+    if (!timer1FastPwm())
+        timer1Top = v;
+    return *this;
+}
+
+SimSpiData &SimSpiData::operator=(uint8_t v)
+{
+    SPI.transfer(v);
+    return *this;
+}
+
+// USART0 in Master SPI mode drives the 74HC595 chain: TXD0 (D1) data, XCK0 (D4) clock
+SimUsartData &SimUsartData::operator=(uint8_t v)
+{
+    bool mspim = (UCSR0C & (_BV(UMSEL01) | _BV(UMSEL00))) == (_BV(UMSEL01) | _BV(UMSEL00));
+    if (mspim && (UCSR0B & _BV(TXEN0)))
+        for (int8_t bit = 7; bit >= 0; bit--)
+            srShift = (srShift << 1) | ((v >> bit) & 1);
+    return *this;
+}
+
+uint8_t EEPROMClass::read(int idx)
+{
+    if (eepromDone)
+    {
+        simStats.eepromReadStalls++;
+        while (EECR & _BV(EEPE))
+            ;
+    }
+    return data[idx % SIM_EEPROM_SIZE];
+}
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+    data[idx % SIM_EEPROM_SIZE] = val;
+    simStats.eepromWrites++;
+    simAdvance(eepromWriteUs);
+}
+
+void SimEepromControl::write(uint8_t v)
+{
+    if (v & _BV(EERE))
+        EEDR = EEPROM.data[EEAR % SIM_EEPROM_SIZE];
+    if ((v & _BV(EEPE)) && !eepromDone && (value & _BV(EEMPE)))
+    {
+        eepromAddress = EEAR;
+        eepromValue = EEDR;
+        eepromDone = now + (uint64_t)eepromWriteUs * SIM_TICKS_PER_US;
+    }
+    else
+        v &= ~_BV(EEPE);
+    if (eepromDone)
+        v |= _BV(EEPE);
+    v &= ~_BV(EERE);
+    if (v & _BV(EEPE))
+        v &= ~_BV(EEMPE); // spent on the write it allowed
+
+    bool enabled = !(value & _BV(EERIE)) && (v & _BV(EERIE));
+    value = v;
+    if (enabled && !eepromDone)
+        raise(SIM_ISR_EE_READY);
+}
+
+SimEepromControl::operator uint8_t() const
+{
+    if (eepromDone)
+        simAdvance(1); // a poll while a write runs, so busy-wait loops end
+    return value;
+}
+
+size_t HardwareSerial::out(const char *fmt, ...)
+{
+    char buffer[128];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+    if (serialEcho)
+        fputs(buffer, stdout);
+    return n < 0 ? 0 : n;
+}
+
+int freeMemory() { return 0; }
+
+/* ---------------- VIRTUAL CLOCK ---------------- */
+
+uint64_t simTicks() { return now; }
+
+void simAdvance(uint32_t microseconds) { simAdvanceTicks((uint64_t)microseconds * SIM_TICKS_PER_US); }
+
+void simAdvanceTicks(uint64_t ticks)
+{
+    uint64_t target = now + ticks;
+
+    for (;;)
+    {
+        uint64_t next = UINT64_MAX;
+        for (uint8_t i = 0; i < TIMER_COUNT; i++)
+        {
+            CompareTimer &t = timers[i];
+            uint64_t period = t.period();
+            if (period != t.currentPeriod)
+            {
+                t.currentPeriod = period;
+                t.next = now + period;
+                if (t.isr == SIM_ISR_ADC)
+                    adcChannel = ADMUX & 0x07; // the first conversion starts now
+            }
+            if (t.currentPeriod && t.next < next)
+                next = t.next;
+        }
+        bool timer1Compare = false;
+        uint64_t timer1Next = timer1Wrap(timer1Compare);
+        if (timer1Next && timer1Next < next)
+            next = timer1Next;
+        if (timer1Held && timer1IsrAt < next)
+            next = timer1IsrAt;
+        if (extClockPeriod && extClockNext < next)
+            next = extClockNext;
+        if (eepromDone && eepromDone < next)
+            next = eepromDone;
+        if (extClockRelease && extClockRelease < next)
+            next = extClockRelease;
+        for (uint8_t i = 0; i < pressCount; i++)
+        {
+            if (presses[i].at && presses[i].at < next)
+                next = presses[i].at;
+            if (presses[i].release && presses[i].release < next)
+                next = presses[i].release;
+        }
+
+        if (next > target)
+            break;
+        now = next;
+
+        for (uint8_t i = 0; i < pressCount; i++)
+        {
+            if (presses[i].at && presses[i].at <= now)
+            {
+                analogLevel[presses[i].channel] = presses[i].value;
+                presses[i].at = 0;
+            }
+            if (!presses[i].at && presses[i].release && presses[i].release <= now)
+            {
+                analogLevel[presses[i].channel] = 1023;
+                presses[i].release = 0;
+            }
+        }
+
+        if (eepromDone && eepromDone <= now)
+        {
+            EEPROM.data[eepromAddress % SIM_EEPROM_SIZE] = eepromValue;
+            simStats.eepromWrites++;
+            eepromDone = 0;
+            EECR &= ~_BV(EEPE);
+            raise(SIM_ISR_EE_READY);
+        }
+
+        if (extClockRelease && extClockRelease <= now)
+        {
+            simSetPin(2, LOW);
+            extClockRelease = 0;
+        }
+
+        if (extClockPeriod && extClockNext <= now)
+        {
+            // jitter moves each edge around the ideal grid without accumulating
+            int32_t jitter = extClockJitter ? (int32_t)(rand() % (2 * extClockJitter + 1)) - (int32_t)extClockJitter : 0;
+            extClockIdeal += extClockPeriod;
+            extClockNext = extClockIdeal + (int64_t)jitter * SIM_TICKS_PER_US;
+            extClockRelease = now + (uint64_t)extClockPulse * SIM_TICKS_PER_US;
+            simSetPin(2, HIGH);
+        }
+
+        for (uint8_t i = 0; i < TIMER_COUNT; i++)
+        {
+            CompareTimer &t = timers[i];
+            if (t.currentPeriod && t.next <= now)
+            {
+                t.next += t.currentPeriod;
+                if (t.isr == SIM_ISR_ADC)
+                {
+                    // the next conversion starts at once on the channel selected now
+                    ADC = analogLevel[adcChannel];
+                    adcChannel = ADMUX & 0x07;
+                }
+                if (t.skip++ % t.decimation == 0)
+                    raise(t.isr);
+            }
+        }
+
+        if (timer1Next && timer1Next <= now)
+        {
+            timer1Bottom = now;
+            if (timer1FastPwm())
+                timer1Top = timer1Buffer;
+            // a match while the last one still waits for its ISR only sets the flag again
+            if (timer1Compare && (TIMSK1 & _BV(OCIE1A)) && !timer1Held && timer1Skip++ % timer1Decimation == 0)
+            {
+                timer1Held = true;
+                timer1IsrAt = now + timer1Latency;
+            }
+        }
+        if (timer1Held && timer1IsrAt <= now)
+        {
+            timer1Held = false;
+            raise(SIM_ISR_TIMER1_COMPA);
+        }
+    }
+
+    now = target;
+}
+
+void sim_cli() { SREG &= ~0x80; }
+
+void sim_sei()
+{
+    SREG |= 0x80;
+    for (uint8_t i = 0; i < SIM_ISR_COUNT; i++)
+    {
+        if (pending[i])
+        {
+            pending[i] = false;
+            callIsr((SimIsr)i);
+        }
+    }
+}
+
+/* ---------------- STIMULUS ---------------- */
+
+void simSetAnalog(uint8_t pin, int value) { analogLevel[(pin - A0) & 0x07] = value; }
+
+void simPressAnalog(uint8_t pin, int value, uint32_t atMs, uint32_t forMs)
+{
+    if (pressCount >= MAX_PRESSES)
+        return;
+    AnalogPress &p = presses[pressCount++];
+    p.channel = (pin - A0) & 0x07;
+    p.value = value;
+    p.at = (uint64_t)atMs * 1000 * SIM_TICKS_PER_US;
+    p.release = p.at + (uint64_t)forMs * 1000 * SIM_TICKS_PER_US;
+    if (p.at == 0)
+        analogLevel[p.channel] = value;
+}
+
+void simSetPin(uint8_t pin, uint8_t level)
+{
+    uint8_t mask;
+    SimPort *port = portFor(pin, mask);
+    uint8_t index = (port == &PORTD) ? 2 : (port == &PORTB) ? 0 : 1;
+    bool rising = level && !(inputLevel[index] & mask);
+    bool falling = !level && (inputLevel[index] & mask);
+
+    if (level)
+        inputLevel[index] |= mask;
+    else
+        inputLevel[index] &= ~mask;
+    volatile uint8_t &pins = (index == 2) ? PIND : (index == 0) ? PINB : PINC;
+    pins = inputLevel[index];
+
+    if (rising || falling)
+    {
+        if (index == 0 && (PCMSK0 & mask))
+            raise(SIM_ISR_PCINT0);
+        if (index == 1 && (PCMSK1 & mask))
+            raise(SIM_ISR_PCINT1);
+    }
+
+    if (pin == 2 && ((rising && (int0Mode == RISING || int0Mode == CHANGE)) ||
+                     (falling && (int0Mode == FALLING || int0Mode == CHANGE))))
+        raise(SIM_ISR_INT0);
+}
+
+void simExternalClock(float bpm, uint32_t jitterUs, uint32_t pulseUs)
+{
+    extClockPeriod = bpm > 0 ? (uint64_t)(60.0 / bpm * SIM_F_CPU + 0.5) : 0;
+    extClockIdeal = now + extClockPeriod;
+    extClockNext = extClockIdeal;
+    extClockJitter = jitterUs;
+    extClockPulse = pulseUs;
+    if (extClockPeriod && !extClockRelease)
+        simSetPin(2, LOW);
+}
+
+void simSetTimer1Decimation(uint16_t n) { timer1Decimation = n ? n : 1; }
+void simSetTimer1Latency(uint32_t ticks) { timer1Latency = ticks; }
+void simSetSerialEcho(bool echo) { serialEcho = echo; }
+void simSetEepromWriteTime(uint32_t microseconds) { eepromWriteUs = microseconds; }
+
+bool simLoadEeprom(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    size_t n = fread(EEPROM.data, 1, sizeof(EEPROM.data), f);
+    fclose(f);
+    return n == sizeof(EEPROM.data);
+}
+
+bool simSaveEeprom(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    size_t n = fwrite(EEPROM.data, 1, sizeof(EEPROM.data), f);
+    fclose(f);
+    return n == sizeof(EEPROM.data);
+}
+
+void simSeedEeprom()
+{
+    // the flat layout from before the pattern store, which imports it on the
+    // first start: 22 byte Patterns of 16 notes, tie and rest bitmasks, length
+    // 16, shuffle 50, pattern p of bank b at index p * 8 + b; patterns 6 and 7
+    // did not fit
+    static const uint8_t notes[16] = {0, 12, 24, 36, 48, 60, 72, 84, 36, 39, 41, 39, 36, 40, 41, 95};
+    const uint8_t patternSize = 22;
+    for (uint16_t index = 0; (index + 1) * patternSize < SIM_EEPROM_SIZE; index++)
+    {
+        if (index % 8 >= 4)
+            continue;
+        uint8_t *p = EEPROM.data + index * patternSize;
+        memcpy(p, notes, sizeof(notes));
+        memset(p + 16, 0, 4);
+        p[20] = 16;
+        p[21] = 50;
+    }
+}
+
+/* ---------------- ARDUINO CORE ---------------- */
+
+void simInit() { UCSR0B = 0; }
+
+uint32_t millis() { return now / (1000 * SIM_TICKS_PER_US); }
+uint32_t micros() { return now / SIM_TICKS_PER_US; }
+void delay(uint32_t ms) { simAdvance(ms * 1000); }
+void delayMicroseconds(unsigned int us) { simAdvance(us); }
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    uint8_t mask;
+    SimPort *port = portFor(pin, mask);
+    volatile uint8_t &ddr = (port == &PORTD) ? DDRD : (port == &PORTB) ? DDRB : DDRC;
+    if (mode == OUTPUT)
+        ddr |= mask;
+    else
+        ddr &= ~mask;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    uint8_t mask;
+    SimPort *port = portFor(pin, mask);
+    if (value)
+        *port |= mask;
+    else
+        *port &= ~mask;
+}
+
+int digitalRead(uint8_t pin)
+{
+    uint8_t mask;
+    SimPort *port = portFor(pin, mask);
+    uint8_t index = (port == &PORTD) ? 2 : (port == &PORTB) ? 0 : 1;
+    return (inputLevel[index] & mask) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) { return analogLevel[(pin >= A0 ? pin - A0 : pin) & 0x07]; }
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode)
+{
+    if (interruptNum != 0)
+        return;
+    int0Callback = userFunc;
+    int0Mode = mode;
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+    if (interruptNum == 0)
+        int0Callback = nullptr;
+}
+
+long random(long howbig) { return howbig ? rand() % howbig : 0; }
+long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { srand(seed); }
+long map(long x, long in_min, long in_max, long out_min, long out_max) { return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min; }
@@ -0,0 +1,167 @@
+/*
+ * Driver for the host-native build: runs the sketch's setup()/loop() against
+ * the virtual clock and reports timing statistics observed on the emulated
+ * outputs.
+ *
+ * Kept in its own translation unit so unit tests, which bring their own
+ * main(), never pull it out of the library archive.
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SimClock.h"
+#include "avr/io.h"
+
+void setup();
+void loop();
+
+namespace
+{
+const uint8_t FUNC_BUTTONS_PIN = 21; // A7
+const int FUNC_PLAY_LEVEL = 339;
+
+void usage(const char *name)
+{
+    printf("usage: %s [options]\n"
+           "  -s seconds   virtual time to run (default 60)\n"
+           "  -l us        virtual cost of one loop() iteration (default 100)\n"
+           "  -r us        random extra loop cost, 0..us (default 0)\n"
+           "  -b bpm       internal tempo the sketch is set to (default 140)\n"
+           "  -x bpm       drive the external clock input at bpm\n"
+           "  -j us        external clock jitter, +/- us\n"
+           "  -d n         call the LED ISR on every n-th compare match (default 1)\n"
+           "  -e file      load the EEPROM image from file (default: demo patterns)\n"
+           "  -w file      save the EEPROM image to file on exit\n"
+           "  -n           do not press PLAY after setup\n"
+           "  -v           echo Serial output\n",
+           name);
+}
+
+double ticksToMs(uint64_t ticks) { return ticks / (double)(SIM_F_CPU / 1000); }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    double seconds = 60;
+    uint32_t loopUs = 100;
+    uint32_t loopJitterUs = 0;
+    double expectedBpm = 140;
+    double extBpm = 0;
+    uint32_t extJitterUs = 0;
+    const char *eepromIn = nullptr;
+    const char *eepromOut = nullptr;
+    bool pressPlay = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        bool takesValue = strchr("slrbxjdew", arg[1]) != nullptr;
+        if (arg[0] != '-' || !arg[1] || arg[2] || (takesValue && !value))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        if (takesValue)
+            i++;
+
+        switch (arg[1])
+        {
+        case 's': seconds = atof(value); break;
+        case 'l': loopUs = atoi(value); break;
+        case 'r': loopJitterUs = atoi(value); break;
+        case 'b': expectedBpm = atof(value); break;
+        case 'x': extBpm = atof(value); break;
+        case 'j': extJitterUs = atoi(value); break;
+        case 'd': simSetTimer1Decimation(atoi(value)); break;
+        case 'e': eepromIn = value; break;
+        case 'w': eepromOut = value; break;
+        case 'n': pressPlay = false; break;
+        case 'v': simSetSerialEcho(true); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (eepromIn)
+    {
+        if (!simLoadEeprom(eepromIn))
+        {
+            fprintf(stderr, "cannot read EEPROM image %s\n", eepromIn);
+            return 1;
+        }
+    }
+    else
+        simSeedEeprom();
+
+    simInit();
+    setup();
+
+    // a chain on USART0 must be set up after init(), or it is never clocked
+    if ((UCSR0C & (_BV(UMSEL01) | _BV(UMSEL00))) && !(UCSR0B & _BV(TXEN0)))
+    {
+        fprintf(stderr, "USART0 is in Master SPI mode but its transmitter is off after setup()\n");
+        return 1;
+    }
+
+    if (pressPlay)
+        simPressAnalog(FUNC_BUTTONS_PIN, FUNC_PLAY_LEVEL, simTicks() / (SIM_F_CPU / 1000) + 10, 60);
+    if (extBpm > 0)
+        simExternalClock(extBpm, extJitterUs);
+
+    uint64_t end = (uint64_t)(seconds * SIM_F_CPU);
+    auto hostStart = std::chrono::steady_clock::now();
+
+    while (simTicks() < end)
+    {
+        auto start = std::chrono::steady_clock::now();
+        loop();
+        simStats.hostLoopNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        simStats.loops++;
+
+        simAdvance(loopUs + (loopJitterUs ? rand() % (loopJitterUs + 1) : 0));
+    }
+
+    double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hostStart).count();
+    double virtualSeconds = simTicks() / (double)SIM_F_CPU;
+
+    printf("virtual time       : %.3f s (%.0fx real time)\n", virtualSeconds, virtualSeconds / hostSeconds);
+    printf("loop() calls       : %llu, %.0f ns host each\n", (unsigned long long)simStats.loops,
+           simStats.loops ? simStats.hostLoopNs / (double)simStats.loops : 0.0);
+    for (uint8_t i = 0; i < SIM_ISR_COUNT; i++)
+        if (simStats.isrCalls[i])
+            printf("%-13s ISR  : %llu calls, %.0f ns host each\n", simIsrNames[i], (unsigned long long)simStats.isrCalls[i],
+                   simStats.isrHostNs[i] / (double)simStats.isrCalls[i]);
+    printf("EEPROM writes      : %llu\n", (unsigned long long)simStats.eepromWrites);
+    printf("EEPROM read stalls : %llu\n", (unsigned long long)simStats.eepromReadStalls);
+    printf("DAC writes         : ch0 %llu (last %u), ch1 %llu (last %u)\n",
+           (unsigned long long)simStats.dacWrites[0], simStats.dacValue[0],
+           (unsigned long long)simStats.dacWrites[1], simStats.dacValue[1]);
+    printf("DAC LDAC latches   : %llu\n", (unsigned long long)simStats.dacLatches);
+    printf("gate out edges     : %llu\n", (unsigned long long)simStats.gateEdges);
+    printf("clock out edges    : %llu\n", (unsigned long long)simStats.clockEdges);
+
+    if (simStats.clockEdges > 1)
+    {
+        uint64_t steps = simStats.clockEdges - 1;
+        double measured = ticksToMs(simStats.lastClockEdge - simStats.firstClockEdge);
+        // the internal clock plays two steps per beat, the external one a step per pulse
+        double stepMs = (extBpm > 0) ? 60000.0 / extBpm : 30000.0 / expectedBpm;
+        double ideal = steps * stepMs;
+        printf("step period        : mean %.3f ms, min %.3f ms, max %.3f ms\n", measured / steps,
+               ticksToMs(simStats.minClockPeriod), ticksToMs(simStats.maxClockPeriod));
+        printf("drift vs %.2f BPM : %+.3f ms over %llu steps (%+.4f %%)\n", extBpm > 0 ? extBpm : expectedBpm,
+               measured - ideal, (unsigned long long)steps, (measured - ideal) / ideal * 100.0);
+    }
+
+    if (eepromOut && !simSaveEeprom(eepromOut))
+    {
+        fprintf(stderr, "cannot write EEPROM image %s\n", eepromOut);
+        return 1;
+    }
+    return 0;
+}
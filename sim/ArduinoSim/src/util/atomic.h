@@ -0,0 +1,22 @@
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+#include "../avr/interrupt.h"
+
+// Restores the interrupt flag on scope exit, like the avr-libc cleanup attribute.
+struct SimAtomicGuard
+{
+    uint8_t saved;
+    SimAtomicGuard() : saved(SREG) { cli(); }
+    ~SimAtomicGuard()
+    {
+        if (saved & 0x80)
+            sei();
+    }
+};
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (SimAtomicGuard simAtomicGuard, *simAtomicOnce = &simAtomicGuard; simAtomicOnce; simAtomicOnce = 0)
+
+#endif
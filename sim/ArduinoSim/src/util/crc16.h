@@ -0,0 +1,17 @@
+#ifndef SIM_UTIL_CRC16_H
+#define SIM_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// Portable versions of the avr-libc CRC helpers the sketch uses.
+
+// Dallas/Maxim 1-Wire CRC-8, polynomial x^8 + x^5 + x^4 + 1, reflected
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+        crc = (crc & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+    return crc;
+}
+
+#endif
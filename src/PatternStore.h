@@ -0,0 +1,512 @@
+#ifndef PATTERNSTORE_H
+#define PATTERNSTORE_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+#include "pattern.h"
+#include "song.h"
+
+const uint8_t STORE_PATTERNS = BANK_MAX * PATTERN_MAX; // the first page of each pattern, id = bank * PATTERN_MAX + pattern
+const uint8_t STORE_SONG = STORE_PATTERNS;              // then the song
+const uint8_t STORE_PAGES = STORE_SONG + 1;             // then the other pages, PATTERN_PAGE_MAX - 1 per pattern
+const uint8_t STORE_WORK = STORE_PAGES + STORE_PATTERNS * (PATTERN_PAGE_MAX - 1); // then a page each of the pattern playing
+const uint8_t STORE_IDS = STORE_WORK + PATTERN_PAGE_MAX;
+const uint8_t STORE_RESERVED = PATTERN_PAGE_MAX + 1; // slots kept for the work records and for rewriting one
+const uint8_t STORE_PAYLOAD = PATTERN_PACKED;
+const uint8_t STORE_RECORD = STORE_PAYLOAD + 3; // payload, id, sequence number, CRC-8
+const uint16_t STORE_LAYOUT_AT = E2END - 1;     // the last two bytes mark the layout
+const uint8_t STORE_MAGIC = 0xA5;
+const uint8_t STORE_LAYOUT = 2; // 1 held version 1 patterns and had no marker
+const uint8_t STORE_SLOTS = STORE_LAYOUT_AT / STORE_RECORD;
+const uint8_t STORE_NONE = 0xFF;
+
+// layout 1, upgraded on the first start
+const uint8_t STORE_V1_RECORD = PATTERN_RAW + 3;
+const uint8_t STORE_V1_SLOTS = (E2END + 1) / STORE_V1_RECORD;
+const uint8_t STORE_V1_SONG_MAX = 10;
+
+// the flat layout from before the store, imported on the first start: a bare
+// version 1 pattern each, pattern p of bank b at index p * STORE_FLAT_STRIDE + b,
+// as far as a whole one fit below E2END
+const uint8_t STORE_FLAT_STRIDE = 8;
+const uint8_t STORE_FLAT_PATTERNS = E2END / PATTERN_RAW;
+
+static_assert(STORE_SLOTS > STORE_PAGES + STORE_RESERVED, "the EEPROM needs a slot for every short pattern, the song and the work records, and a spare one");
+static_assert(STORE_IDS < STORE_NONE, "ids are bytes");
+static_assert(STORE_SLOTS >= STORE_V1_SLOTS && STORE_RECORD <= STORE_V1_RECORD, "layout 1 records are upgraded in place");
+static_assert(STORE_SLOTS >= STORE_FLAT_PATTERNS && STORE_RECORD <= PATTERN_RAW, "flat patterns are imported in place");
+
+/**
+ * Wear-levelled pattern storage in the EEPROM, written from the EE_READY
+ * interrupt so a save never blocks loop().
+ *
+ * The EEPROM is a pool of fixed size records, each holding one packed
+ * pattern page (or the song), its id, a sequence number counting the saves
+ * of that id, and a CRC over all three. A pattern longer than a page takes a
+ * record per page from the same pool, so the spare slots are shared with
+ * long patterns and a save fails once none is left. The slots the work
+ * records may take are kept back, so an edited page leaving RAM always
+ * finds one. A save goes to the first free slot
+ * after the one holding the current copy, so repeated saves of a pattern
+ * walk over all spare slots instead of wearing out one, and the copy it
+ * replaces stays valid until the new record is complete. begin() takes the
+ * valid record with the newest sequence number for every id, so a save cut
+ * short by a power loss leaves the previous copy in place. Pages past the
+ * end of their pattern, and the work records of the pattern playing, are
+ * not taken back then.
+ *
+ * The interrupt compares every byte with the EEPROM first and programs only
+ * the ones that differ. The sequence number and CRC come last, so a record
+ * is only ever valid once its payload is complete. The id of every slot is
+ * kept in RAM, so finding or releasing a record never waits for a byte
+ * being programmed; only reading a payload does, unless readable() says so.
+ */
+class PatternStore
+{
+private:
+  volatile uint8_t live[(STORE_SLOTS + 7) / 8]; // a bit per slot holding a current record; ISR writes on completion
+  uint8_t slotId[STORE_SLOTS];                  // the id of the record in every slot, so finding one reads no EEPROM
+  volatile bool writing = false;                // a save is in progress, even while held by readable()
+
+  // the save in progress, owned by the ISR while EERIE is set
+  uint8_t record[STORE_RECORD];
+  uint8_t pending = STORE_NONE; // its id, STORE_NONE once released
+  uint8_t target;
+  uint8_t replaced; // slot of the copy it supersedes, STORE_NONE if none
+  uint8_t position;
+
+  static inline uint16_t address(uint8_t slot) { return slot * STORE_RECORD; }
+
+  // over a whole record but its last byte
+  static uint8_t crc(const uint8_t *data, uint8_t size = STORE_RECORD)
+  {
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < size - 1; i++)
+      crc = _crc_ibutton_update(crc, data[i]);
+    return crc;
+  }
+
+  // newer in serial number arithmetic, so the counter may wrap
+  static inline bool newer(uint8_t sequence, uint8_t than) { return (int8_t)(sequence - than) > 0; }
+
+  inline bool isLive(uint8_t slot) { return live[slot >> 3] & _BV(slot & 7); }
+  inline void setLive(uint8_t slot, bool isLive)
+  {
+    if (isLive)
+      live[slot >> 3] |= _BV(slot & 7);
+    else
+      live[slot >> 3] &= ~_BV(slot & 7);
+  }
+
+  /**
+   * Stops the save in progress from interrupting while the main loop reads.
+   * EEPROM.read() waits for a write in progress, and the interrupt must not
+   * move EEAR or mark slots meanwhile.
+   * @return what to hand to resume()
+   */
+  uint8_t pause()
+  {
+    uint8_t saving = EECR & _BV(EERIE);
+    EECR &= ~_BV(EERIE);
+    return saving;
+  }
+
+  void resume(uint8_t saving) { EECR |= saving; }
+
+  void read(uint16_t from, uint8_t *data, uint8_t length)
+  {
+    uint8_t saving = pause();
+    for (uint8_t i = 0; i < length; i++)
+      data[i] = EEPROM.read(from + i);
+    resume(saving);
+  }
+
+  // the slot of the current record of an id, STORE_NONE if none; with the save paused
+  uint8_t find(uint8_t id)
+  {
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+      if (isLive(slot) && slotId[slot] == id)
+        return slot;
+    return STORE_NONE;
+  }
+
+  // the first slot after a given one not holding a current record, STORE_NONE if the pool is full
+  uint8_t freeAfter(uint8_t slot)
+  {
+    for (uint8_t i = 0; i < STORE_SLOTS; i++)
+    {
+      slot = (slot + 1) % STORE_SLOTS;
+      if (!isLive(slot))
+        return slot;
+    }
+    return STORE_NONE;
+  }
+
+  /**
+   * The sequence number for a new record of an id without a current one,
+   * counting on from any valid record left over, so the new one is newest
+   */
+  uint8_t nextSequence(uint8_t id)
+  {
+    uint8_t sequence = 0;
+    bool found = false;
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+    {
+      if (EEPROM.read(address(slot) + STORE_PAYLOAD) != id)
+        continue;
+      read(address(slot), record, STORE_RECORD);
+      if (crc(record) != record[STORE_RECORD - 1])
+        continue;
+      if (!found || newer(record[STORE_PAYLOAD + 1] + 1, sequence))
+        sequence = record[STORE_PAYLOAD + 1] + 1;
+      found = true;
+    }
+    return sequence;
+  }
+
+  void scan()
+  {
+    uint8_t sequence[STORE_SLOTS];
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+    {
+      read(address(slot), record, STORE_RECORD);
+      bool valid = record[STORE_PAYLOAD] < STORE_WORK && crc(record) == record[STORE_RECORD - 1];
+      slotId[slot] = valid ? record[STORE_PAYLOAD] : STORE_NONE;
+      sequence[slot] = record[STORE_PAYLOAD + 1];
+    }
+
+    // the newest copy of every id, the first one found on a tie
+    memset((uint8_t *)live, 0, sizeof(live));
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+    {
+      bool newest = slotId[slot] != STORE_NONE;
+      for (uint8_t other = 0; other < STORE_SLOTS && newest; other++)
+        if (other != slot && slotId[other] == slotId[slot])
+          newest = !(newer(sequence[other], sequence[slot]) || (sequence[other] == sequence[slot] && other < slot));
+      setLive(slot, newest);
+    }
+
+    // pages left over from a longer version of their pattern
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+    {
+      if (!isLive(slot) || slotId[slot] < STORE_PAGES)
+        continue;
+      uint8_t first = find((slotId[slot] - STORE_PAGES) / (PATTERN_PAGE_MAX - 1));
+      uint8_t page = (slotId[slot] - STORE_PAGES) % (PATTERN_PAGE_MAX - 1) + 1;
+      if (first == STORE_NONE || patternPages(Pattern::packedLength(EEPROM.read(address(first)))) <= page)
+        setLive(slot, false);
+    }
+  }
+
+  // writes the record buffer to a slot with a blocking EEPROM.update()
+  void put(uint8_t slot, uint8_t id, uint8_t sequence)
+  {
+    record[STORE_PAYLOAD] = id;
+    record[STORE_PAYLOAD + 1] = sequence;
+    record[STORE_RECORD - 1] = crc(record);
+    for (uint8_t i = 0; i < STORE_RECORD; i++)
+      EEPROM.update(address(slot) + i, record[i]);
+  }
+
+  // a slot holding nothing, so leftovers of the old layout never pass as a record
+  void kill(uint8_t slot) { EEPROM.update(address(slot) + STORE_PAYLOAD, STORE_NONE); }
+
+  /**
+   * Reads a layout 1 record and, if it is valid, packs its payload into the
+   * record buffer
+   * @return the id, or STORE_NONE
+   */
+  uint8_t readV1(uint8_t slot, uint8_t &sequence)
+  {
+    uint8_t old[STORE_V1_RECORD];
+    for (uint8_t i = 0; i < STORE_V1_RECORD; i++)
+      old[i] = EEPROM.read(slot * STORE_V1_RECORD + i);
+    uint8_t id = old[PATTERN_RAW];
+    sequence = old[PATTERN_RAW + 1];
+    if (id > STORE_SONG || crc(old, STORE_V1_RECORD) != old[STORE_V1_RECORD - 1])
+      return STORE_NONE;
+
+    memset(record, 0, STORE_PAYLOAD);
+    if (id == STORE_SONG)
+    {
+      if (old[0] > STORE_V1_SONG_MAX)
+        return STORE_NONE;
+      Song song;
+      memcpy(&song, old, sizeof(Song));
+      song.length = min(song.length, SONG_MAX);
+      memcpy(record, &song, sizeof(Song));
+    }
+    else
+    {
+      if (old[20] < 1 || old[20] > PAGE_STEPS || old[21] > 100)
+        return STORE_NONE;
+      Pattern pattern;
+      pattern.unpackRaw(old);
+      pattern.pack(record);
+    }
+    return id;
+  }
+
+  /**
+   * Upgrades layout 1, whose records go from 25 to 21 bytes. Each new slot
+   * starts at or below the old one of the same number, so going up reads
+   * every old record before a new one overwrites it.
+   * @return false, having written nothing, if no layout 1 record was found
+   */
+  bool upgrade()
+  {
+    uint8_t sequence;
+    bool found = false;
+    for (uint8_t slot = 0; slot < STORE_V1_SLOTS && !found; slot++)
+      found = readV1(slot, sequence) != STORE_NONE;
+    if (!found)
+      return false;
+
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+    {
+      uint8_t id = (slot < STORE_V1_SLOTS) ? readV1(slot, sequence) : STORE_NONE;
+      if (id != STORE_NONE)
+        put(slot, id, sequence);
+      else
+        kill(slot);
+    }
+    return true;
+  }
+
+  /**
+   * Imports an EEPROM written before the store existed. The pattern at flat
+   * index i goes to slot i, which starts at or below it, so going up reads
+   * every pattern before a record overwrites it. Erased patterns and the
+   * indices of no bank are skipped.
+   */
+  void import()
+  {
+    uint8_t raw[PATTERN_RAW];
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+    {
+      uint8_t bank = slot % STORE_FLAT_STRIDE;
+      uint8_t index = slot / STORE_FLAT_STRIDE;
+      uint8_t erased = 0xFF;
+      if (slot < STORE_FLAT_PATTERNS && bank < BANK_MAX && index < PATTERN_MAX)
+        for (uint8_t i = 0; i < PATTERN_RAW; i++)
+          erased &= raw[i] = EEPROM.read(slot * PATTERN_RAW + i);
+      if (erased == 0xFF)
+      {
+        kill(slot);
+        continue;
+      }
+      Pattern pattern;
+      pattern.unpackRaw(raw);
+      pattern.pack(record);
+      put(slot, bank * PATTERN_MAX + index, 0);
+    }
+  }
+
+public:
+  static PatternStore *singleton; // used inside the ISR
+
+  PatternStore() { PatternStore::singleton = this; }
+
+  /**
+   * Identifies the record of a pattern page
+   * @param pattern bank * PATTERN_MAX + pattern
+   * @param page 0..PATTERN_PAGE_MAX - 1
+   */
+  static uint8_t pageId(uint8_t pattern, uint8_t page)
+  {
+    return page ? STORE_PAGES + pattern * (PATTERN_PAGE_MAX - 1) + page - 1 : pattern;
+  }
+
+  /**
+   * Finds the current record of every pattern; call once in setup(). The
+   * first start after an update brings older layouts over, which blocks for
+   * a few seconds.
+   */
+  void begin()
+  {
+    if (EEPROM.read(STORE_LAYOUT_AT) != STORE_MAGIC || EEPROM.read(STORE_LAYOUT_AT + 1) != STORE_LAYOUT)
+    {
+      if (!upgrade())
+        import();
+      EEPROM.update(STORE_LAYOUT_AT, STORE_MAGIC);
+      EEPROM.update(STORE_LAYOUT_AT + 1, STORE_LAYOUT);
+    }
+    scan();
+  }
+
+  /** true while a save is being written */
+  bool busy() { return writing; }
+
+  /**
+   * The free slots left for pattern pages and the song, beyond those kept
+   * for the work records; a save replacing a record needs one until the
+   * old copy is let go
+   */
+  uint8_t spare()
+  {
+    uint8_t free = 0, kept = STORE_RESERVED;
+    for (uint8_t slot = 0; slot < STORE_SLOTS; slot++)
+      if (!isLive(slot) && !(writing && slot == target))
+        free++;
+      else if (slotId[slot] >= STORE_WORK)
+        kept--;
+    return free > kept ? free - kept : 0;
+  }
+
+  /** whether an id has a current record */
+  bool has(uint8_t id) { return find(id) != STORE_NONE; }
+
+  /**
+   * Whether load() would return at once. While a byte of a save is being
+   * programmed it would wait for it, so the save is held after that byte
+   * until carryOn() and asking again a few milliseconds later gets a yes.
+   */
+  bool readable()
+  {
+    EECR &= ~_BV(EERIE);
+    return !(EECR & _BV(EEPE));
+  }
+
+  /** lets a save held by readable() go on once its byte is programmed; call from loop() */
+  void carryOn()
+  {
+    if (writing && !(EECR & _BV(EEPE)))
+      EECR |= _BV(EERIE);
+  }
+
+  /**
+   * Reads the newest saved copy of a pattern page or the song; waits for a
+   * byte of a save being programmed unless readable() was true
+   * @param id pageId() or STORE_SONG
+   * @param payload receives length bytes
+   * @param length up to STORE_PAYLOAD
+   * @return false if it was never saved
+   */
+  bool load(uint8_t id, uint8_t *payload, uint8_t length = STORE_PAYLOAD)
+  {
+    if (busy() && id == pending)
+    {
+      memcpy(payload, record, length);
+      return true;
+    }
+    uint8_t saving = pause();
+    uint8_t slot = find(id);
+    if (slot != STORE_NONE)
+      for (uint8_t i = 0; i < length; i++)
+        payload[i] = EEPROM.read(address(slot) + i);
+    resume(saving);
+    return slot != STORE_NONE;
+  }
+
+  /**
+   * Queues a pattern page or the song to be written in the background; one
+   * identical to the stored copy writes nothing. Never waits: the caller
+   * keeps what the store refused and retries once busy() is false.
+   * @param id pageId(), STORE_SONG or STORE_WORK + page
+   * @param payload copied before this returns
+   * @param length up to STORE_PAYLOAD, the rest of the record is zeroed
+   * @return false, keeping the stored copy, while the previous save is
+   * still being written or if no slot is free, or spare() is 0 for an id
+   * that is not a work record
+   */
+  bool save(uint8_t id, const uint8_t *payload, uint8_t length = STORE_PAYLOAD)
+  {
+    if (busy())
+      return false;
+
+    uint8_t staged[STORE_PAYLOAD];
+    memcpy(staged, payload, length);
+    memset(staged + length, 0, STORE_PAYLOAD - length);
+
+    uint8_t current = find(id);
+    uint8_t sequence;
+    if (current != STORE_NONE)
+    {
+      read(address(current), record, STORE_RECORD);
+      if (memcmp(record, staged, STORE_PAYLOAD) == 0)
+        return true;
+      sequence = record[STORE_PAYLOAD + 1] + 1;
+    }
+    else
+      sequence = nextSequence(id);
+
+    if (id < STORE_WORK && spare() == 0)
+      return false;
+    uint8_t slot = freeAfter(current == STORE_NONE ? STORE_SLOTS - 1 : current);
+    if (slot == STORE_NONE)
+      return false;
+
+    memcpy(record, staged, STORE_PAYLOAD);
+    record[STORE_PAYLOAD] = id;
+    record[STORE_PAYLOAD + 1] = sequence;
+    record[STORE_RECORD - 1] = crc(record);
+
+    pending = id;
+    target = slot;
+    slotId[slot] = id;
+    replaced = current;
+    position = 0;
+    writing = true;
+    EECR |= _BV(EERIE);
+    return true;
+  }
+
+  /**
+   * Frees the slot of the current record of an id for other saves; a save
+   * of it in progress is written but not made current. The record stays in
+   * the EEPROM; a later save of the id counts on from it.
+   * @param id a page past the end of its pattern, or a work record
+   */
+  void release(uint8_t id)
+  {
+    uint8_t saving = pause();
+    if (busy() && id == pending)
+      pending = STORE_NONE;
+    uint8_t slot = find(id);
+    if (slot != STORE_NONE)
+      setLive(slot, false);
+    resume(saving);
+  }
+
+  /**
+   * Programs the next differing byte of the pending record; called from the
+   * EE_READY interrupt, which fires whenever the EEPROM is ready for a write
+   */
+  inline void ready()
+  {
+    uint16_t base = address(target);
+    while (position < STORE_RECORD)
+    {
+      uint8_t value = record[position];
+      EEAR = base + position++;
+      EECR |= _BV(EERE);
+      if (EEDR != value)
+      {
+        EEDR = value;
+        EECR |= _BV(EEMPE);
+        EECR |= _BV(EEPE);
+        return;
+      }
+    }
+
+    if (pending != STORE_NONE)
+      setLive(target, true);
+    if (replaced != STORE_NONE)
+      setLive(replaced, false);
+    writing = false;
+    EECR &= ~_BV(EERIE);
+  }
+};
+
+PatternStore *PatternStore::singleton = {0};
+
+// EEPROM ready interrupt service routine
+ISR(EE_READY_vect)
+{
+  PatternStore::singleton->ready();
+}
+
+#endif
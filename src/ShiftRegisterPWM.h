@@ -4,7 +4,11 @@
 #include <Arduino.h>
 #include <stdlib.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include "SimpleTimer.h"
+#include "RingBuffer.h"
+#include "LedMap.h"
 
 #define DATA_PIN 4 // Shift Register - pin 14
 #define LATCH_PIN 5
@@ -27,32 +31,144 @@
     ShiftRegisterPWM_LATCH_PORT ^= ShiftRegisterPWM_LATCH_MASK; \
     ShiftRegisterPWM_LATCH_PORT ^= ShiftRegisterPWM_LATCH_MASK
 
-#ifndef ShiftRegisterPWM_IGNORE_PINS
-#define ShiftRegisterPWM_IGNORE_PINS \
-    {                                \
-        29, 30                       \
-    }
+// Transport for the 74HC595 chain. The default bit-bangs DATA_PIN/CLOCK_PIN.
+// With ShiftRegisterPWM_USART_SPI the bytes go out through USART0 in Master SPI
+// mode at 8 MHz, which needs the chain rewired: serial data to TXD0 (D1) and
+// the shift clock to XCK0 (D4); the latch stays on LATCH_PIN. USART0 is then
+// no longer available to Serial.
+#ifndef ShiftRegisterPWM_USART_SPI
+#define ShiftRegisterPWM_USART_SPI false
+#endif
+
+#if (ShiftRegisterPWM_USART_SPI)
+#define USART_XCK_PIN 4
+#if (LOGGING) || (SHOWMEM)
+#error "ShiftRegisterPWM_USART_SPI takes USART0 away from Serial, disable LOGGING and SHOWMEM"
+#endif
 #endif
 
-const uint8_t ignorePins[] = ShiftRegisterPWM_IGNORE_PINS; //ShiftRegisterPWM_IGNORE_PINS;
-const uint8_t resolution = 255;                            // number of brightness increments
-volatile uint8_t dutyCounter = 0;
-volatile uint8_t isrCounter = 0;
-uint32_t ioData = (uint32_t)0x00000000;
-uint32_t ioFlashData = (uint32_t)0x00000000;
-uint32_t ioDimData = (uint32_t)0x00000000;
+const uint8_t resolution = 255; // number of brightness increments
+
+// perceived brightness of each pin, 0..255, applied in BitCodeModulation mode;
+// without bitplanes any level below full is shown by the dim blink
+const uint8_t LED_LEVEL_FULL = 255;
+const uint8_t LED_LEVEL_DIMMED = 48;
+
+// perceived brightness to on-time, round(255 * (i / 255) ^ 2.2), never 0 for a lit LED
+const uint8_t ledGamma[256] PROGMEM = {
+      0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
 
-uint8_t speed = resolution;
-uint32_t dutyCycleMask;
+// animation of each pin, mode in the top 3 bits and phase (1/32 of a cycle) below
+const uint8_t LED_ANIM_SHIFT = 5;
+const uint8_t LED_PHASE_MASK = 0x1F;
 
-class ShiftRegisterPWM
+// one cycle of a raised cosine, round(255 * (1 - cos(2 * pi * i / 64)) / 2)
+const uint8_t ledWave[64] PROGMEM = {
+      0,   1,   2,   5,  10,  15,  21,  29,  37,  47,  57,  67,  79,  90, 103, 115,
+    127, 140, 152, 165, 176, 188, 198, 208, 218, 226, 234, 240, 245, 250, 253, 254,
+    255, 254, 253, 250, 245, 240, 234, 226, 218, 208, 198, 188, 176, 165, 152, 140,
+    128, 115, 103,  90,  79,  67,  57,  47,  37,  29,  21,  15,  10,   5,   2,   1,
+};
+const uint8_t LED_ONE_SHOT_DONE = 64; // frames a one-shot takes to fade out (0.5 s)
+
+// Binary code modulation: bitplane n is shown for BCM_BASE << n timer ticks,
+// so a frame of 8 interrupts lasts 255 * BCM_BASE ticks (125.5 Hz)
+const uint16_t BCM_BASE = 500; // ticks at prescaler 1, longer than one update()
+const uint8_t BCM_PLANES = 8;
+
+// Layers merged into each published frame. The sequence lights show the
+// step layer (ioData), transient flashes on top of it, and the value picker
+// overlay over both while a dialog is open; the pins from LED_STATUS on are
+// the status LEDs and outputs.
+enum LedLayer : uint8_t
 {
+    LAYER_STEP = 1,
+    LAYER_TRANSIENT = 2,
+    LAYER_OVERLAY = 4,
+    LAYER_STATUS = 8,
+    LAYER_ALL = 0x0F
+};
+const uint8_t LAYER_SEQUENCE = LAYER_STEP | LAYER_TRANSIENT | LAYER_OVERLAY;
+const uint16_t LED_TRANSIENT_MS = 600; // how long a transient flash stays over the step layer
+
+/**
+ * LED driver for a chain of REGISTERS 74HC595s, wired as in LedMap.h. The
+ * chain length sets the width of every pin mask and unrolls the shift
+ * routine at compile time; use the ShiftRegisterPWM typedef below.
+ */
+template <uint8_t REGISTERS>
+class BasicShiftRegisterPWM
+{
+    static_assert(LED_STATUS + 16 <= REGISTERS * 8, "the chain has no room for the pins in LedMap.h");
+
+public:
+    typedef typename LedBits<REGISTERS>::type Bits;
+    static const uint8_t PINS = REGISTERS * 8;
+
 private:
+    // What the ISR shows. ioData, ioFlashData, ledLevel and ledAnim are only ever
+    // touched by the main loop, which copies them into the back frame and publishes it.
+    struct LedFrame
+    {
+        Bits data;
+        Bits flash;
+        uint8_t level[PINS];
+        uint8_t anim[PINS];
+    };
+
+    template <uint8_t BYTES>
+    struct Bytes
+    {
+    };
+
+    Bits ioData = 0;
+    Bits ioFlashData = 0;
+    uint8_t ledLevel[PINS];
+    uint8_t ledAnim[PINS]; // animation of each pin, see setAnimation()
+    uint8_t speed = resolution;
+    volatile uint8_t dutyCounter = 0;
+    volatile uint8_t isrCounter = 0;
+
     SimpleTimer flashTimer = SimpleTimer(150);
     SimpleTimer dimTimer = SimpleTimer(25);
+    SimpleTimer transientTimer = SimpleTimer();
     bool flashState = false;
     bool dimState = false;
 
+    uint16_t overlayData = 0;
+    uint16_t overlayFlashData = 0;
+    bool overlayVisible = false;
+    Bits transientData = 0;
+    uint8_t dirty = 0;     // layers changed since the last publish()
+    uint8_t backStale = 0; // layers the back frame missed at the last publish()
+
+    volatile bool bitCodeModulation = false;
+    LedFrame frames[2];
+    volatile uint8_t front = 0; // frame the ISR reads, written by publish() only
+    Bits bitplanes[BCM_PLANES];
+    volatile uint8_t bitplane = 0; // next plane to send
+
+    // animation state, owned by the ISR
+    uint8_t frameCount = 0;
+    uint8_t oneShotAge[PINS];
+    RingBuffer<uint8_t, 8> oneShots; // pins triggered by the main loop
+
     inline void shiftOut(uint8_t data) const
     {
         // unrolled for loop
@@ -145,6 +261,259 @@ private:
         ShiftRegisterPWM_toggleClockPinTwice();
     };
 
+    // clock, gate and other outputs: not pulse width modulated, and changed at once
+    static constexpr Bits dutyCycleMask() { return ((Bits)1 << outClock) | ((Bits)1 << outGate); }
+    static constexpr Bits sequenceMask() { return ((Bits)1 << LED_STEPS) - 1; }
+    static inline Bits pinBit(uint8_t pin) { return (Bits)1 << pin; }
+
+    // the pins from first below full level, blinked by the loop without bitplanes
+    Bits dimmedPins(uint8_t first, uint8_t last) const
+    {
+        Bits dimmed = 0;
+        for (uint8_t pin = first; pin < last; pin++)
+            if (ledLevel[pin] < LED_LEVEL_FULL)
+                dimmed |= pinBit(pin);
+        return dimmed;
+    }
+
+    // one shiftOut() per register, most significant first, unrolled by overload resolution
+    inline void shiftBytes(Bits, Bytes<0>) const {}
+
+    template <uint8_t BYTES>
+    inline void shiftBytes(Bits data, Bytes<BYTES>) const
+    {
+        shiftOut(data >> (8 * (BYTES - 1)));
+        shiftBytes(data, Bytes<BYTES - 1>());
+    }
+
+#if (ShiftRegisterPWM_USART_SPI)
+    // the Arduino core's init() turns USART0 off after the constructors ran, so this runs from interrupt()
+    void beginUsart() const
+    {
+        UBRR0 = 0;
+        pinMode(USART_XCK_PIN, OUTPUT);             // XCK0 as output selects master mode
+        UCSR0C = (1 << UMSEL01) | (1 << UMSEL00);   // Master SPI, MSB first, SPI mode 0
+        UCSR0B = (1 << TXEN0);
+        UBRR0 = 0;                                  // F_CPU / 2, set again once the transmitter is on
+    }
+
+    inline void usartBytes(Bits, Bytes<0>) const {}
+
+    template <uint8_t BYTES>
+    inline void usartBytes(Bits data, Bytes<BYTES>) const
+    {
+        if (BYTES + 2 <= REGISTERS) // the first two bytes fill UDR0 and the shift register
+            while (!(UCSR0A & (1 << UDRE0)))
+                ;
+        UDR0 = data >> (8 * (BYTES - 1));
+        usartBytes(data, Bytes<BYTES - 1>());
+    }
+
+    /**
+     * Queues the frame without waiting for the last byte to leave: the
+     * first two bytes fill UDR0 and the shift register at once, so the ISR
+     * only waits for REGISTERS - 2 byte times. The frame is latched by the
+     * next interrupt.
+     */
+    inline void usartOut(Bits data) const { usartBytes(data, Bytes<REGISTERS>()); }
+#endif
+
+    // sends one frame to the chain; with the USART the frame sent last time is latched first
+    inline void writeFrame(Bits data) const
+    {
+#if (ShiftRegisterPWM_USART_SPI)
+        ShiftRegisterPWM_toggleLatchPinTwice(); // the previous frame has long been shifted in
+        usartOut(data);
+#else
+        shiftBytes(data, Bytes<REGISTERS>());
+        ShiftRegisterPWM_toggleLatchPinTwice();
+#endif
+    }
+
+    // a bitplane with the outputs (dutyCycleMask pins) taken live from the published frame
+    inline Bits planeData(uint8_t plane) const
+    {
+        return (bitplanes[plane] & ~dutyCycleMask()) | (frames[front].data & dutyCycleMask());
+    }
+
+    static inline uint8_t scale(uint8_t level, uint8_t factor)
+    {
+        return ((uint16_t)level * factor + 255) >> 8;
+    }
+
+    /**
+     * Applies a pin's animation to its level for the current frame. Flash
+     * repeats every 32 frames (255 ms), breathe every 256 frames (2 s).
+     * A flashing pin (ioFlashData) flashes whatever its animation.
+     */
+    uint8_t animate(uint8_t pin, uint8_t level, uint8_t anim, bool flashing)
+    {
+        uint8_t phase = anim & LED_PHASE_MASK;
+        uint8_t mode = anim >> LED_ANIM_SHIFT;
+        if (flashing)
+            mode = FLASH;
+
+        switch (mode)
+        {
+        case FLASH:
+            return ((frameCount + phase) & 0x10) ? 0 : level;
+        case BREATHE:
+            return scale(level, pgm_read_byte_near(ledWave + (((frameCount >> 2) + (phase << 1)) & 63)));
+        case ONE_SHOT:
+            if (oneShotAge[pin] >= LED_ONE_SHOT_DONE)
+                return 0;
+            return scale(level, pgm_read_byte_near(ledWave + 32 + (oneShotAge[pin]++ >> 1)));
+        default:
+            return level;
+        }
+    }
+
+    /**
+     * Prepares the next frame's bitplanes: plane n holds the LEDs whose
+     * animated, gamma corrected brightness, scaled by the global pulse width,
+     * has bit n set
+     */
+    void buildBitplanes()
+    {
+        const LedFrame &frame = frames[front];
+        Bits planes[BCM_PLANES] = {0};
+        Bits leds = frame.data & ~dutyCycleMask();
+        Bits bit = 1;
+
+        frameCount++;
+        uint8_t triggered;
+        while (oneShots.pop(triggered))
+            oneShotAge[triggered] = 0;
+
+        for (uint8_t pin = 0; leds; pin++, bit <<= 1, leds >>= 1)
+        {
+            if (!(leds & 1))
+                continue;
+            uint8_t level = animate(pin, frame.level[pin], frame.anim[pin], frame.flash & bit);
+            level = scale(level, speed);
+            uint8_t onTime = pgm_read_byte_near(ledGamma + level);
+            for (uint8_t plane = 0; onTime; plane++, onTime >>= 1)
+                if (onTime & 1)
+                    planes[plane] |= bit;
+        }
+
+        for (uint8_t plane = 0; plane < BCM_PLANES; plane++)
+            bitplanes[plane] = planes[plane];
+    }
+
+    /**
+     * One binary code modulation interrupt: sends the next plane and programs
+     * the compare interval of the one after it. OCR1A is double buffered in
+     * fast PWM mode and only taken over once the interval now starting ends,
+     * so an interrupt entered late cannot set an interval the counter has
+     * already passed.
+     */
+    inline void updateBitplane()
+    {
+        uint8_t plane = bitplane;
+#if (ShiftRegisterPWM_USART_SPI)
+        uint8_t timed = plane; // latched by the next interrupt, shown after it
+#else
+        uint8_t timed = (plane + 1) & (BCM_PLANES - 1);
+#endif
+        OCR1A = ((unsigned)BCM_BASE << timed) - 1;
+        writeFrame(planeData(plane));
+        bitplane = (plane + 1) & (BCM_PLANES - 1);
+
+        uint16_t cycles = TCNT1;
+        if (cycles > updateCycles)
+            updateCycles = cycles;
+
+        if (plane == BCM_PLANES - 1)
+        {
+            // the last plane of the frame is out, prepare the next frame; this takes
+            // longer than a Timer2 period, so let the step clock and CV interrupts in
+            sei();
+            buildBitplanes();
+        }
+    }
+
+    /**
+     * Rewrites the visible plane at once so an output change does not wait
+     * for the plane to end, which in BCM mode can take up to 4 ms
+     */
+    void refreshOutputs()
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+#if (ShiftRegisterPWM_USART_SPI)
+            uint8_t pending = (bitplane - 1) & (BCM_PLANES - 1);
+            uint8_t shown = (pending - 1) & (BCM_PLANES - 1);
+            while (!(UCSR0A & (1 << TXC0)))
+                ;
+            UCSR0A = (1 << TXC0);
+            usartOut(planeData(shown));
+            while (!(UCSR0A & (1 << TXC0)))
+                ;
+            ShiftRegisterPWM_toggleLatchPinTwice();
+            usartOut(planeData(pending)); // put back the frame the next interrupt latches
+#else
+            uint8_t shown = (bitplane - 1) & (BCM_PLANES - 1);
+            writeFrame(planeData(shown));
+#endif
+        }
+    }
+
+    // writes the sequence lights of a frame from the step, transient and overlay layers
+    void composeSequence(LedFrame &frame)
+    {
+        Bits data, flashing;
+        if (overlayVisible)
+        {
+            data = overlayData;
+            flashing = overlayFlashData;
+            memset(frame.level, LED_LEVEL_FULL, LED_STEPS);
+            memset(frame.anim, STEADY, LED_STEPS);
+        }
+        else
+        {
+            data = (ioData | transientData) & sequenceMask();
+            flashing = (ioFlashData | transientData) & sequenceMask();
+            memcpy(frame.level, ledLevel, LED_STEPS);
+            memcpy(frame.anim, ledAnim, LED_STEPS);
+            for (uint8_t pin = 0; pin < LED_STEPS; pin++)
+                if (bitRead(transientData, pin))
+                    frame.anim[pin] = STEADY;
+        }
+
+        // without bitplanes the loop blinks flashing and dimmed LEDs by blanking them
+        if (!bitCodeModulation)
+        {
+            if (flashState)
+                data &= ~flashing;
+            if (dimState && !overlayVisible)
+                data &= ~dimmedPins(0, LED_STEPS);
+        }
+
+        frame.data = (frame.data & ~sequenceMask()) | (data & sequenceMask());
+        frame.flash = (frame.flash & ~sequenceMask()) | flashing;
+    }
+
+    // writes the status pins of a frame from the status layer
+    void composeStatus(LedFrame &frame)
+    {
+        Bits data = ioData & ~sequenceMask();
+        if (!bitCodeModulation)
+        {
+            if (flashState)
+                data &= ~ioFlashData;
+            if (dimState)
+                data &= ~dimmedPins(LED_STEPS, PINS);
+        }
+
+        frame.data = (frame.data & sequenceMask()) | data;
+        frame.flash = (frame.flash & sequenceMask()) | (ioFlashData & ~sequenceMask());
+        memcpy(frame.level + LED_STEPS, ledLevel + LED_STEPS, PINS - LED_STEPS);
+        memcpy(frame.anim + LED_STEPS, ledAnim + LED_STEPS, PINS - LED_STEPS);
+    }
+
+    inline void markDirty(uint8_t pin) { dirty |= (pin < LED_STEPS) ? LAYER_STEP : LAYER_STATUS; }
+
 public:
     enum UpdateFrequency
     {
@@ -152,10 +521,26 @@ public:
         Slow,     // 12,800 Hz interrupt
         Medium,   // 25,600 Hz interrupt
         Fast,     // 35,714 Hz interrupt
-        SuperFast // 51,281 Hz interrupt
+        SuperFast, // 51,281 Hz interrupt
+        BitCodeModulation // 8 interrupts per 125.5 Hz frame, 1,004 Hz on average
     };
 
-    static ShiftRegisterPWM *singleton; // used inside the ISR
+    // per-pin animations, run by the ISR at frame rate in BitCodeModulation mode
+    enum Animation : uint8_t
+    {
+        STEADY,
+        FLASH,    // on/off, 3.9 Hz
+        BREATHE,  // slow fade in and out, 0.5 Hz
+        ONE_SHOT  // full on, fades out once in 0.5 s, see trigger()
+    };
+
+    static BasicShiftRegisterPWM *singleton; // used inside the ISR
+
+    // CPU cycles from the timer compare match to the end of the slowest update()
+    // seen so far, ISR entry included; with bitplanes up to the end of the plane
+    // write, which must stay under BCM_BASE. Read from Timer1, so only valid with
+    // prescaler 1; read it with getUpdateCycles()
+    volatile uint16_t updateCycles = 0;
 
     /**
     * Constructor for a new ShiftRegisterPWM object. 
@@ -164,19 +549,21 @@ public:
     * @param latchPin the Latch Pin of the Shift Register
     * @param clockPin the Clock Pin of the Shift Register
     */
-    ShiftRegisterPWM()
+    BasicShiftRegisterPWM()
     {
-        ShiftRegisterPWM::singleton = this; // make this object accessible for timer interrupts
+        BasicShiftRegisterPWM::singleton = this; // make this object accessible for timer interrupts
+        memset(ledLevel, LED_LEVEL_FULL, sizeof(ledLevel));
+        memset(ledAnim, STEADY, sizeof(ledAnim));
+        memset(oneShotAge, LED_ONE_SHOT_DONE, sizeof(oneShotAge));
+        dirty = LAYER_ALL;
+        publish();
         pinMode(OUTPUT_ENABLE_PIN, OUTPUT);
         digitalWrite(OUTPUT_ENABLE_PIN, 0);
+        pinMode(LATCH_PIN, OUTPUT);
+#if !(ShiftRegisterPWM_USART_SPI)
         pinMode(DATA_PIN, OUTPUT);
         pinMode(CLOCK_PIN, OUTPUT);
-        pinMode(LATCH_PIN, OUTPUT);
-
-        // set up the duty-cycle mask to ignore pins
-        dutyCycleMask = 0;
-        for (uint8_t x = 0; x < sizeof(ignorePins); x++)
-            bitSet(dutyCycleMask, ignorePins[x]);
+#endif
     }
 
     void setPulseWidth(uint8_t newSpeed)
@@ -186,18 +573,88 @@ public:
 
     void flash()
     {
-        if (flashTimer.done())
+        // without bitplanes there are no per-LED levels or animations, the loop
+        // blinks flashing LEDs and dimmed LEDs fast instead
+        if (!bitCodeModulation)
         {
-            flashState = !flashState;
-            ioData ^= ioFlashData;
+            if (flashTimer.done())
+            {
+                flashState = !flashState;
+                dirty = LAYER_ALL;
+            }
+
+            if (dimTimer.done())
+            {
+                dimState = !dimState;
+                dirty = LAYER_ALL;
+            }
         }
 
-        if (dimTimer.done()) {
-
-            dimState = !dimState;
-            ioData ^= ioDimData;
+        if (transientData && transientTimer.done(false))
+        {
+            transientData = 0;
+            dirty |= LAYER_TRANSIENT;
         }
-    }    
+
+        publish();
+    }
+
+    /**
+     * Hands everything set since the last call to the ISR. The layers are
+     * merged into the buffer the ISR is not reading, which is made current
+     * with a single byte store, so the ISR always shows a whole frame and
+     * neither side needs to disable interrupts. Only the halves whose layers
+     * changed since that buffer was last written are merged, and nothing is
+     * done when no layer changed. Called from flash() once per loop.
+     */
+    void publish()
+    {
+        uint8_t update = dirty | backStale;
+        if (!update)
+            return;
+
+        uint8_t back = front ^ 1;
+        if (update & LAYER_SEQUENCE)
+            composeSequence(frames[back]);
+        if (update & LAYER_STATUS)
+            composeStatus(frames[back]);
+        front = back;
+        backStale = dirty;
+        dirty = 0;
+    }
+
+    /**
+     * Shows the value picker over the sequence lights until hideOverlay();
+     * the step layer underneath keeps running
+     * @param data lit sequence lights
+     * @param flashData flashing sequence lights
+     */
+    void showOverlay(uint16_t data, uint16_t flashData)
+    {
+        overlayData = data;
+        overlayFlashData = flashData;
+        overlayVisible = true;
+        dirty |= LAYER_OVERLAY;
+    }
+
+    void hideOverlay()
+    {
+        if (overlayVisible)
+            dirty |= LAYER_OVERLAY;
+        overlayVisible = false;
+    }
+
+    /**
+     * Flashes a sequence light over the step layer for a short while
+     * @param pin 0..LED_STEPS - 1
+     * @param ms how long the flash lasts
+     */
+    void flashTransient(uint8_t pin, uint16_t ms = LED_TRANSIENT_MS)
+    {
+        transientData |= pinBit(pin);
+        transientTimer.start(ms);
+        dirty |= LAYER_TRANSIENT;
+    }
 
     enum Brightness {
         DIMMED,
@@ -206,33 +663,76 @@ public:
 
     void setBrightness(uint8_t pin, Brightness brightness)
     {
-        if (brightness == Brightness::FULL)
-            bitClear(ioDimData, pin);
-        else
-            bitSet(ioDimData, pin);
-            
+        setLevel(pin, (brightness == Brightness::FULL) ? LED_LEVEL_FULL : LED_LEVEL_DIMMED);
+    }
+
+    /**
+     * Sets the brightness of a pin, shown from the next frame
+     * @param pin 0..PINS - 1
+     * @param level perceived brightness, 0..255; gamma corrected on output
+     */
+    void setLevel(uint8_t pin, uint8_t level)
+    {
+        ledLevel[pin] = level;
+        markDirty(pin);
+    }
+    uint8_t getLevel(uint8_t pin) { return ledLevel[pin]; }
+
+    /**
+     * Sets the animation the ISR plays on a pin while it is lit, shown from the next frame
+     * @param pin 0..PINS - 1
+     * @param animation STEADY, FLASH, BREATHE or ONE_SHOT
+     * @param phase offset into the cycle in 1/32 steps, 0..31, so neighbours can run out of step
+     */
+    void setAnimation(uint8_t pin, Animation animation, uint8_t phase = 0)
+    {
+        ledAnim[pin] = (animation << LED_ANIM_SHIFT) | (phase & LED_PHASE_MASK);
+        markDirty(pin);
+    }
+    Animation getAnimation(uint8_t pin) { return (Animation)(ledAnim[pin] >> LED_ANIM_SHIFT); }
+
+    /**
+     * Lights a pin at full level and lets the ISR fade it out once
+     * @param pin 0..PINS - 1
+     */
+    void trigger(uint8_t pin)
+    {
+        setAnimation(pin, ONE_SHOT);
+        ioData |= pinBit(pin);
+        ioFlashData &= ~pinBit(pin);
+        oneShots.push(pin);
     }
 
     /**
      * sets or clears the ShiftRegister pin
-     * @param pin The pin on the shift register whose value will be set. 0-7 on SR1, 8-15 on SR2, .... 31 (4 SRs)
-     * @param value Should be set to 0 or 1 for now ... TODO: later will add flashing, or even better PULSING!
+     * @param pin The pin on the shift register whose value will be set. 0-7 on SR1, 8-15 on SR2, .... PINS - 1
+     * @param value 0 = off, 1 = on, 2 = flashing; other animations are set with setAnimation()
      */
     void set(uint8_t pin, uint8_t value)
     {
+        if (getAnimation(pin) == ONE_SHOT)
+            ledAnim[pin] = STEADY; // a pin set again leaves its one-shot
         switch (value)
         {
         case 1:
-            bitSet(ioData, pin);
-            bitClear(ioFlashData, pin);
+            ioData |= pinBit(pin);
+            ioFlashData &= ~pinBit(pin);
             break;
         case 2:
-            bitSet(ioData, pin);
-            bitSet(ioFlashData, pin);
+            ioData |= pinBit(pin);
+            ioFlashData |= pinBit(pin);
             break;
         default:
-            bitClear(ioData, pin);
-            bitClear(ioFlashData, pin);
+            ioData &= ~pinBit(pin);
+            ioFlashData &= ~pinBit(pin);
+        }
+        markDirty(pin);
+
+        if (dutyCycleMask() & pinBit(pin))
+        {
+            publish(); // outputs do not wait for the next loop
+            if (bitCodeModulation)
+                refreshOutputs();
         }
     }
 
@@ -246,23 +746,27 @@ public:
         return bitRead(ioFlashData, pin) == 1 ? 2 : bitRead(ioData, pin);
     }
 
-    uint32_t getData() { return ioData; }
-    void setData(uint32_t data)
+    Bits getData() { return ioData; }
+    void setData(Bits data)
     {
         ioData = data;
+        dirty = LAYER_ALL;
     }
 
-    uint32_t getFlashData() { return ioFlashData; }
-    void setFlashData(uint32_t data)
+    Bits getFlashData() { return ioFlashData; }
+    void setFlashData(Bits data)
     {
         ioFlashData = data;
+        dirty = LAYER_ALL;
     }
 
     void clearSequenceLights()
     {
-        ioData &= (uint32_t)0xFFFF0000;
-        ioFlashData &= (uint32_t)0xFFFF0000;
-        ioDimData &= (uint32_t) 0xFFFF0000;
+        ioData &= ~sequenceMask();
+        ioFlashData &= ~sequenceMask();
+        memset(ledLevel, LED_LEVEL_FULL, LED_STEPS);
+        memset(ledAnim, STEADY, LED_STEPS);
+        dirty |= LAYER_STEP;
     }
 
     /** 
@@ -271,16 +775,18 @@ public:
     */
     void update()
     {
-        uint32_t dataForWrite = ioData;
+        if (bitCodeModulation)
+        {
+            updateBitplane();
+            return;
+        }
 
-        if (dutyCounter > speed)           // if not dutyCycle
-            dataForWrite &= dutyCycleMask; // set the ShiftRegister pins to PWM off duty cycle
+        Bits dataForWrite = frames[front].data;
 
-        shiftOut(dataForWrite >> 24);
-        shiftOut(dataForWrite >> 16);
-        shiftOut(dataForWrite >> 8);
-        shiftOut(dataForWrite);
-        ShiftRegisterPWM_toggleLatchPinTwice();
+        if (dutyCounter > speed)             // if not dutyCycle
+            dataForWrite &= dutyCycleMask(); // set the ShiftRegister pins to PWM off duty cycle
+
+        writeFrame(dataForWrite);
 
         // update the pulseCounter
         dutyCounter++;
@@ -289,15 +795,27 @@ public:
             dutyCounter = 0;
             isrCounter = 0;
         }
+
+        uint16_t cycles = TCNT1;
+        if (cycles > updateCycles)
+            updateCycles = cycles;
+    }
+
+    // updateCycles, read atomically
+    uint16_t getUpdateCycles()
+    {
+        uint16_t cycles;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { cycles = updateCycles; }
+        return cycles;
     }
 
     /**
     * Calls void ShiftRegisterPWM::interrupt(UpdateFrequency updateFrequency) with the UpdateFrequency Medium 
     * Have a look at the called function for more details.
     */
-    void interrupt() const
+    void interrupt()
     {
-        this->interrupt(ShiftRegisterPWM::UpdateFrequency::Medium);
+        this->interrupt(UpdateFrequency::Medium);
     };
 
     /** 
@@ -306,10 +824,18 @@ public:
     * The function can be called multiple times with different update frequencies in order to change the update frequency at any time.
     * @param updateFrequency The update frequencies are either VerySlow @ 6,400 Hz, Slow @ 12,800 Hz, Fast @ 35,714 Hz, SuperFast @ 51,281.5 Hz, and Medium @ 25,600 Hz. 
     * The actual PWM cycle length in seconds can be calculated by (resolution / frequency).
+    * BitCodeModulation instead shows 8 precomputed bitplanes per frame for binary weighted times, 8 interrupts per frame.
     */
-    void interrupt(UpdateFrequency updateFrequency) const
+    void interrupt(UpdateFrequency updateFrequency)
     {
         cli(); // disable interrupts
+#if (ShiftRegisterPWM_USART_SPI)
+        beginUsart();
+#endif
+        bitCodeModulation = (updateFrequency == BitCodeModulation);
+        dirty = LAYER_ALL; // flashing is blanked by the loop only without bitplanes
+        bitplane = 0;
+        buildBitplanes();
 
         // reset
         TCCR1A = 0; // set TCCR1A register to 0
@@ -338,6 +864,11 @@ public:
             TCCR1B |= (1 << CS10); // prescaler 1
             break;
 
+        case BitCodeModulation:    // OCR1A is reprogrammed for every bitplane
+            OCR1A = BCM_BASE - 1;  // compare match register
+            TCCR1B |= (1 << CS10); // prescaler 1
+            break;
+
         case Medium: // exactly 25,600 Hz interrupt frequency
         default:
             OCR1A = 624;           // compare match register
@@ -345,7 +876,14 @@ public:
             break;
         }
 
-        TCCR1B |= (1 << WGM12);  // turn on CTC mode
+        if (bitCodeModulation)
+        {
+            TCCR1A = (1 << WGM11) | (1 << WGM10); // fast PWM with TOP = OCR1A, which double buffers it
+            TCCR1B |= (1 << WGM13) | (1 << WGM12);
+            OCR1A = BCM_BASE - 1; // the buffer, for the interval after the first
+        }
+        else
+            TCCR1B |= (1 << WGM12);  // turn on CTC mode
         TIMSK1 |= (1 << OCIE1A); // enable timer compare interrupt
 
         sei(); // allow interrupts
@@ -353,7 +891,10 @@ public:
 };
 
 // One static reference to the ShiftRegisterPWM that was lastly created. Used for access through timer interrupts.
-ShiftRegisterPWM *ShiftRegisterPWM::singleton = {0};
+template <uint8_t REGISTERS>
+BasicShiftRegisterPWM<REGISTERS> *BasicShiftRegisterPWM<REGISTERS>::singleton = {0};
+
+typedef BasicShiftRegisterPWM<LED_REGISTERS> ShiftRegisterPWM;
 
 //Timer 1 interrupt service routine (ISR)
 ISR(TIMER1_COMPA_vect)
@@ -6,7 +6,7 @@
 #include <avr/interrupt.h>
 #include "sequencer.h"
 #include "controls.h"
-#include "dac.h"
+#include "CvOutput.h"
 #if (SHOWMEM)
 #include "memory.h"
 #endif
@@ -27,23 +27,26 @@ void handleRightRotaryEncoder();
 void handlePianoKeys();
 void updateControls();
 void showFreeMemory(uint8_t i);
-void cvOut(uint8_t channel, uint16_t v);
+void showIsrCycles();
 void updateLoading();
 void updateSaving();
 void updateKnobs();
 void updatePatternStorage();
+void dropSequencerInput();
+void handleSongButtons();
 
 #pragma endregion
 
 #pragma region GLOBAL VARS
 
-MP4822 dac;
+CvOutput cv;
+QuadratureDecoder encoders;
+ShiftRegisterPWM sr; // before seq, which keeps a pointer to it
 Sequencer seq;
-ShiftRegisterPWM sr;
 StorageAction storageAction = StorageAction::LOAD_PATTERN;
 
 void interruptCallback() { seq.externalClockTrigger(); }
-void cvOut(uint8_t channel, int16_t v) { dac.DAC_set(channel, v); }
+int16_t pitchCV() { return seq.getPitchCV(); }
 
 #pragma endregion
 
@@ -59,34 +62,41 @@ void setup()
 #endif
     showFreeMemory(1);
     setupIO();
+    encoders.begin();
     setupKnobs();
+    patternStore.begin(); // before the timers start, a first start imports the old layout
+    loadSong();
 
-    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::Slow);
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+    cv.setPitchSource(pitchCV);
+    cv.begin(STEPCLOCK_RATE);
+    seq.begin();
     attachInterrupt(digitalPinToInterrupt(CLK_IN), interruptCallback, RISING);
     seq.setBpm(140);
     loadPattern(0, 0);
     seq.setPatternLength(pattern.length);
+    seq.setShuffle(pattern.shuffle);
     showFreeMemory(7);
 }
 
 void setupKnobs()
 {
-    knob[0] = new Knob(0, encoderButtons, KNOB1_A, KNOB1_B);
-    knob[0]->setRange(ledOFF, 0, 0, MAXTEMPO / TEMPODIV);
+    knob[0] = new Knob(0, encoderButtons);
+    knob[0]->setRange(ledOFF, 0, MIN_BPM, MAX_BPM);
     knob[0]->setRange(ledOFF, 1, 1, 50); // brightness
     knob[0]->setRange(ledOFF, 2, 0, 24); // gate duration % of note
-    knob[0]->setRange(ledON, 0, 20, MAXTEMPO / TEMPODIV);
+    knob[0]->setRange(ledON, 0, MIN_BPM, MAX_BPM);
     knob[0]->setRange(ledON, 1, 1, 50);   // brightness
     knob[0]->setRange(ledON, 2, -20, 20); // shuffle -10:hard shuffle | 0:no shuffle | +10: hard reverse shuffle
     knob[0]->addModes(new KnobFunction[6]{TempoAdjust, StepSelect, GateTime, TempoAdjust, StepSelect, GateTime});
     knob[0]->setMode(0);
-    knob[0]->setValue(120 / 10); // bpmMilliseconds
+    knob[0]->setValue(140); // bpm
 
-    knob[1] = new Knob(1, encoderButtons, KNOB2_A, KNOB2_B);
+    knob[1] = new Knob(1, encoderButtons);
     knob[1]->setRange(ledOFF, 0, 1, 5);    // play mode
     knob[1]->setRange(ledOFF, 1, 0, 24);   // glide time
     knob[1]->setRange(ledOFF, 2, -24, 24); // pitch
-    knob[1]->setRange(ledON, 0, 1, 4);     // play mode
+    knob[1]->setRange(ledON, 0, 0, CLOCK_RATIO_COUNT - 1); // external clock ratio
     knob[1]->setRange(ledON, 1, 0, 24);    // glide time
     knob[1]->setRange(ledON, 2, -24, 24);  // pitch
     knob[1]->addModes(new KnobFunction[6]{
@@ -94,7 +104,7 @@ void setupKnobs()
         PlayMode, GlideTime, Pitch});
     knob[1]->setMode(0);
 
-    knob[2] = new Knob(2, encoderButtons, KNOB3_A, KNOB3_B);
+    knob[2] = new Knob(2, encoderButtons);
     knob[2]->setRange(ledOFF, 0, 1, PATTERN_STEP_MAX); // pattern length
     knob[2]->setRange(ledOFF, 1, 0, 3);                // glide shape/curve
     knob[2]->setRange(ledOFF, 2, 1, 8);                // octave
@@ -115,8 +125,11 @@ void setupKnobs()
 void loop()
 {
     seq.update();
+    continueSave();
+    showIsrCycles();
 
-    cvOut(0, seq.getPitchCV());
+    if (uiState != UIState::SEQUENCER)
+        dropSequencerInput();
 
     switch (uiState)
     {
@@ -129,6 +142,21 @@ void loop()
     }
 }
 
+// prints the slowest LED interrupt so far whenever it gets slower
+void showIsrCycles()
+{
+#if (SHOWMEM)
+    static uint16_t shown = 0;
+    uint16_t cycles = sr.getUpdateCycles();
+    if (cycles > shown)
+    {
+        shown = cycles;
+        Serial.print(F("sr isr cycles="));
+        Serial.println(cycles);
+    }
+#endif
+}
+
 #pragma endregion
 
 #pragma region STATE LOADING / SAVING
@@ -144,15 +172,15 @@ void selectBank(Knob *k, UIState nextState)
 #endif
         k->setValue(memBank);
         sr.set(ledENTER, LedState::ledFLASH);
-        for (byte i = 16; i < 25; i++)
-            sr.set(i, (i < 22) ? ledOFF : ledON);
-        sr.set(16, LedState::ledFLASH);
+        for (byte i = 0; i < sizeof(ledKnob); i++)
+            sr.set(pgm_read_byte_near(ledKnob + i), (i < 6) ? ledOFF : ledON);
+        sr.set(pgm_read_byte_near(ledKnob), LedState::ledFLASH);
         seq.setValuePicker(memBank, 0, 3, false);
     }
 
     if (k->didChange())
     {
-        memBank = constrain(memBank + k->direction(), 0, BANK_MAX - 1);
+        memBank = constrain(memBank + k->steps(), 0, BANK_MAX - 1);
 #if (LOGGING)
         Serial.print(F("bank: "));
         Serial.println(memBank);
@@ -175,13 +203,13 @@ void selectPattern(Knob *k, UIState nextState)
         Serial.println(F("select pattern"));
 #endif
         k->setValue(memPattern);
-        sr.set(19, LedState::ledFLASH);
+        sr.set(pgm_read_byte_near(ledKnob + 3), LedState::ledFLASH);
         seq.setValuePicker(memPattern, 0, PATTERN_MAX - 1, false);
     }
 
     if (k->didChange())
     {
-        memPattern = constrain(memPattern + k->direction(), 0, PATTERN_MAX - 1);
+        memPattern = constrain(memPattern + k->steps(), 0, PATTERN_MAX - 1);
 #if (LOGGING)
         Serial.print(F("pattern: "));
         Serial.println(memPattern);
@@ -197,15 +225,24 @@ void selectPattern(Knob *k, UIState nextState)
 void finishedStorageAction()
 {
     seq.setValuePicker(9, 0, 9, true, 500);
-    seq.setPatternLength(pattern.length);
-    seq.setShuffle(pattern.shuffle);
-    sr.set(ledENTER, LedState::ledOFF);
+    sr.trigger(ledENTER); // fades out to confirm
     uiState = UIState::SEQUENCER;
 #if (LOGGING)
     Serial.println(F("load/save complete"));
 #endif
 }
 
+// the store has no room for the pattern: an empty bar instead of a full one, and no confirmation
+void refusedStorageAction()
+{
+    seq.setValuePicker(0, 0, 9, true, 1000);
+    sr.set(ledENTER, LedState::ledOFF);
+    uiState = UIState::SEQUENCER;
+#if (LOGGING)
+    Serial.println(F("save refused, the store is full"));
+#endif
+}
+
 void updatePatternStorage()
 {
     switch (uiState)
@@ -220,9 +257,14 @@ void updatePatternStorage()
 
     case UIState::ACTION_COMPLETE:
         if (storageAction == StorageAction::LOAD_PATTERN)
-            loadPattern(memBank, memPattern);
-        else
-            savePattern(memBank, memPattern);
+            seq.cuePattern(memBank, memPattern);
+        else if (savingPattern())
+            break; // the last save or edits are still being written, try again next loop
+        else if (!savePattern(memBank, memPattern))
+        {
+            refusedStorageAction();
+            break;
+        }
         finishedStorageAction();
 
     default:
@@ -230,6 +272,17 @@ void updatePatternStorage()
     }
 }
 
+// the sequencer controls are not read while a pattern is picked; what they
+// queue meanwhile is dropped rather than played back once the sequencer is back
+void dropSequencerInput()
+{
+    encoderButtons.flush();
+    pianoBlack.flush();
+    pianoWhite.flush();
+    encoders.take(0);
+    encoders.take(1);
+}
+
 void showKnobSelectorLeds()
 {
     knob[0]->setLED();
@@ -325,6 +378,12 @@ void handleFunctionButtons()
         showFreeMemory(99);
     }
 
+    if (sr.get(ledSHIFT) == LedState::ledON)
+    {
+        handleSongButtons();
+        return;
+    }
+
     if (funcButtons.onPress(SAVE))
     {
 #if (LOGGING)
@@ -344,6 +403,38 @@ void handleFunctionButtons()
     }
 }
 
+// with SHIFT: SAVE adds the last loaded or saved pattern to the song at the
+// current transpose, holding it clears the song; LOAD starts or stops the song
+void handleSongButtons()
+{
+    if (funcButtons.onPress(SAVE))
+    {
+        song.append(memBank, memPattern, seq.getTranspose());
+        saveSong();
+        seq.setValuePicker(song.length, 0, SONG_MAX, true, 500);
+    }
+
+    if (funcButtons.onPressAfter(SAVE, 1000))
+    {
+        seq.stopSong();
+        song.clear();
+        saveSong();
+        seq.setValuePicker(0, 0, SONG_MAX, true, 500);
+    }
+
+    if (funcButtons.onPress(LOAD))
+    {
+#if (LOGGING)
+        Serial.println(F("song play/stop"));
+#endif
+        if (seq.isPlayingSong())
+            seq.stopSong();
+        else
+            seq.playSong();
+        sr.set(ledSHIFT, ledOFF);
+    }
+}
+
 void updateKnobs()
 {
     for (uint8_t i = 0; i < 3; i++)
@@ -391,31 +482,10 @@ void handleLeftRotaryEncoder()
         {
         case 0: // TEMPO
         {
-            uint16_t newTempo;
-            int16_t steps = k->getRangeMax() - k->getRangeMin();
-            int16_t precisionPoint = steps / 2.0 + (k->getRangeMin() - 1);
-
-#if (LOGGING)
-            char buffer[100];
-            sprintf(buffer, "value: %d\tsteps: %d\tx-over: %d\t", value, steps, precisionPoint);
-            Serial.print(buffer);
-#endif
-            if (value <= precisionPoint)
-                newTempo = k->getRangeMin() + ((value - k->getRangeMin()) * 10) + 20;
-            else
-            {
-#if (LOGGING)
-                Serial.print(" XO ");
-#endif
-                int16_t nonLinearSteps = k->getRangeMax() - precisionPoint;
-                float factor = (value - precisionPoint) / (double)nonLinearSteps;
-                newTempo = value * factor * TEMPODIV;
-                newTempo += k->getRangeMin() + ((value - k->getRangeMin()) * 10);
-            }
-            seq.setBpm(newTempo);
+            seq.setBpm(value); // one BPM per step, the knob accelerates for large changes
 #if (LOGGING)
             Serial.print(F("bpm: "));
-            Serial.println(newTempo);
+            Serial.println(value);
 #endif
             seq.setValuePicker(value, k->getRangeMin(), k->getRangeMax());
 
@@ -475,19 +545,34 @@ void handleMiddleRotaryEncoder()
         short value = k->value();
         switch (k->getMode())
         {
-        case 0: // playMode
-            playMode = static_cast<PlayModes>(k->value());
-            seq.setValuePicker(value, k->getRangeMin(), k->getRangeMax());
+        case 0:
+            switch (sr.get(ledSHIFT))
+            {
+            case ledOFF: // playMode
+                playMode = static_cast<PlayModes>(k->value());
+                seq.setValuePicker(value, k->getRangeMin(), k->getRangeMax());
+                break;
+
+            case ledON: // SHIFT-external clock ratio
+            {
+                uint8_t ratio = seq.changeClockRatio(k->direction());
+                k->setValue(ratio);
+                seq.setValuePicker(ratio, k->getRangeMin(), k->getRangeMax());
+                break;
+            }
+
+            default:
+                break;
+            }
             break;
 
         case 1: // glide time
-            Serial.println(value / (float)k->getRangeMax());
-            seq.setGlideTime(value / (float)k->getRangeMax());
+            seq.setGlideTime(value * 100 / k->getRangeMax());
             seq.setValuePicker(value, k->getRangeMin(), k->getRangeMax());
             break;
 
         case 2: // pitch
-            seq.setTranspose(k->direction());
+            seq.setTranspose(k->steps());
             int8_t newTranspose = seq.getTranspose();
             k->setValue(newTranspose);
             seq.setValuePicker(newTranspose, k->getRangeMin(), k->getRangeMax());
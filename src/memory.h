@@ -2,14 +2,15 @@
 #define MY_MEMORY_H
 
 #include <Arduino.h>
-#include <EEPROM.h>
 #include "pattern.h"
+#include "song.h"
+#include "PatternStore.h"
 #if (SHOWMEM)
 #include "MemoryFree.h"
 #endif
 
 // Memory Banks
-const uint8_t BANK_MAX = 4; // number of pattern banks
+PatternStore patternStore;
 uint8_t memBank = 0;
 uint8_t memPattern = 0;
 
@@ -18,6 +19,43 @@ const uint8_t TIE = REST + 1;
 const uint8_t MIDI_OFFSET = 23;
 uint8_t _pattern[] = {0, 12, 24, 36, 48, 60, 72, 84, 36, 39, 41, 39, 36, 40, 41, 95};
 Pattern pattern = Pattern();
+Song song = Song();
+
+// The pattern playing is paged: the RAM holds the page of the current step,
+// the others are read from the store as the playhead gets to them. A page
+// comes from the record of the pattern it was loaded from or saved to, or
+// from a work record once it was edited and paged out, so edits survive a
+// page turn while the stored pattern only changes on a save.
+uint8_t pageFrom[PATTERN_PAGE_MAX] = {STORE_NONE, STORE_NONE, STORE_NONE, STORE_NONE}; // store id of every page of the pattern playing
+bool pageEdited = false;            // the page in RAM differs from its record
+
+// Nothing on the playback path writes to the store. An edited page leaving
+// RAM waits here for continueSave(), which writes it to its work record,
+// STORE_WORK + page, once the store is free. A page leaving again before
+// then takes the place of its own copy.
+uint8_t outPage[PATTERN_PAGE_MAX][PATTERN_PACKED];
+uint8_t outQueued = 0; // a bit per page waiting
+
+// A save in progress, a page per call of continueSave(). It copies the pages
+// from the records they were read from when it started, and the page then in
+// RAM from its own copy, so neither a page turn nor another pattern opening
+// meanwhile changes what it writes.
+uint8_t saveTo = STORE_NONE;        // bank * PATTERN_MAX + pattern
+uint8_t savePages = 0;              // still to be written, the first page going last
+uint8_t saveFrom[PATTERN_PAGE_MAX]; // record of every page when the save started
+uint8_t saveHot[PATTERN_PACKED];    // the page in RAM then, with the header
+uint8_t saveHotPage;
+uint8_t saveStale = 0; // a bit per page edited or replaced since, which keeps its record
+
+bool songPending = false; // the song changed and waits for the store
+
+// The page the next beat plays from, read by the main loop between the bytes
+// of a save, so a page turn on the playback path finds it in RAM rather than
+// waiting for the EEPROM
+uint8_t aheadFrom = STORE_NONE; // its store id, STORE_NONE if none was read
+uint8_t aheadPage[PATTERN_PACKED];
+
+static_assert(sizeof(Song) <= STORE_PAYLOAD, "the song must fit in one store record");
 
 enum StorageAction
 {
@@ -35,23 +73,283 @@ void showFreeMemory(uint8_t i = 99)
 #endif
 }
 
-void savePattern(uint8_t toSlot, uint8_t inBank)
+/**
+ * Reads the first page of a stored pattern
+ * @param slot bank * PATTERN_MAX + pattern
+ * @return false, leaving the pattern unchanged, if the slot was never saved
+ */
+bool readPattern(uint8_t slot, Pattern &into)
+{
+  uint8_t packed[PATTERN_PACKED];
+  if (!patternStore.load(slot, packed) || !into.unpack(packed))
+    return false;
+  into.page = 0;
+  return true;
+}
+
+// the steps of a page of the pattern playing, blank if it has no record
+void readPage(uint8_t page, uint8_t *packed)
+{
+  if ((outQueued & _BV(page)) && pageFrom[page] == STORE_WORK + page)
+    memcpy(packed, outPage[page], PATTERN_PACKED);
+  else if (aheadFrom != STORE_NONE && pageFrom[page] == aheadFrom)
+    memcpy(packed, aheadPage, PATTERN_PACKED);
+  else if (!patternStore.load(pageFrom[page], packed))
+    memset(packed, 0, PATTERN_PACKED);
+}
+
+/**
+ * Reads a page into RAM before the playhead gets to it, once no byte of a
+ * save is being programmed; call from loop()
+ * @param id its store id, STORE_NONE if the page in RAM will do
+ */
+void readAhead(uint8_t id)
+{
+  if (id == STORE_NONE || id == aheadFrom || !patternStore.readable())
+    return;
+  if (id >= STORE_WORK && id < STORE_IDS && (outQueued & _BV(id - STORE_WORK)))
+    return; // readPage() finds it waiting to go out
+  if (!patternStore.load(id, aheadPage))
+    memset(aheadPage, 0, PATTERN_PACKED);
+  aheadFrom = id;
+}
+
+// the page read ahead is stale once its record is saved or released
+void changeRecord(uint8_t id)
 {
-  uint8_t patternSize = sizeof(Pattern);
-  uint16_t slotLocation = (toSlot * patternSize) + (inBank * patternSize * PATTERN_MAX);  
-  
-  uint8_t *data = pattern.bytes();
-  if ((slotLocation + patternSize) < EEPROM.length()) 
-    for (uint8_t i = 0; i < patternSize; i++)
-      EEPROM.write(slotLocation + i, data[i]);
+  if (id == aheadFrom)
+    aheadFrom = STORE_NONE;
 }
 
-void loadPattern(uint8_t fromSlot, uint8_t inBank)
-{  
-  int slotLocation = (fromSlot * sizeof(Pattern)) + (inBank * sizeof(Pattern) * PATTERN_MAX);
-  
-  for (uint8_t i = 0; i < sizeof(Pattern); i++)
-    ((uint8_t *)&pattern)[i] = EEPROM.read(slotLocation + i);
+// whether the save in progress still has to copy a page from a record
+bool savesFrom(uint8_t id)
+{
+  for (uint8_t page = 0; page < savePages && saveTo != STORE_NONE; page++)
+    if (page != saveHotPage && saveFrom[page] == id)
+      return true;
+  return false;
+}
+
+// frees a work record once neither the pattern playing nor a save reads it
+void dropWork(uint8_t id)
+{
+  if (id < STORE_WORK || id >= STORE_IDS)
+    return;
+  for (uint8_t page = 0; page < PATTERN_PAGE_MAX; page++)
+    if (pageFrom[page] == id)
+      return;
+  outQueued &= ~_BV(id - STORE_WORK); // edits of a page left behind
+  if (savesFrom(id))
+    return;
+  changeRecord(id);
+  patternStore.release(id);
+}
+
+/** marks the page in RAM edited; call after changing a step */
+void editPage()
+{
+  pageEdited = true;
+  saveStale |= _BV(pattern.page);
+}
+
+// writes a page waiting to leave RAM to its work record
+void writeOut(uint8_t page)
+{
+  uint8_t id = STORE_WORK + page;
+  changeRecord(id);
+  if (patternStore.save(id, outPage[page]))
+    outQueued &= ~_BV(page);
+  // else a store filled before it kept slots for the work records; the page
+  // stays queued and readPage() keeps serving it
+}
+
+/**
+ * Writes the next page of the save in progress
+ */
+void savePage()
+{
+  uint8_t page = savePages - 1;
+  uint8_t id = PatternStore::pageId(saveTo, page);
+  uint8_t packed[PATTERN_PACKED];
+  if (page == saveHotPage)
+    memcpy(packed, saveHot, PATTERN_PACKED);
+  else if (!patternStore.load(saveFrom[page], packed))
+    memset(packed, 0, PATTERN_PACKED);
+  if (page == 0)
+    memcpy(packed, saveHot, 2);
+  else
+    packed[0] = packed[1] = 0; // the header is kept with the first page
+
+  // the pages past the end are let go before the store is busy with the
+  // first one; their records stay valid until it is written
+  if (page == 0)
+    for (uint8_t past = patternPages(Pattern::packedLength(saveHot[0])); past < PATTERN_PAGE_MAX; past++)
+    {
+      uint8_t pastId = PatternStore::pageId(saveTo, past);
+      if (!(saveStale & _BV(past)))
+      {
+        uint8_t was = pageFrom[past];
+        pageFrom[past] = pastId;
+        dropWork(was);
+      }
+      changeRecord(pastId);
+      patternStore.release(pastId);
+    }
+
+  changeRecord(id);
+  if (!patternStore.save(id, packed))
+  {
+    saveTo = STORE_NONE; // savePattern() found room, so only a corrupt store gets here
+    for (page = 0; page < PATTERN_PAGE_MAX; page++)
+      dropWork(saveFrom[page]);
+    return;
+  }
+  savePages--;
+  if (!(saveStale & _BV(page)))
+  {
+    uint8_t was = pageFrom[page];
+    pageFrom[page] = id;
+    if (page == pattern.page)
+      pageEdited = false;
+    dropWork(was);
+  }
+  dropWork(saveFrom[page]);
+  if (page == 0)
+    saveTo = STORE_NONE;
+}
+
+/**
+ * Writes what waits for the store, a record per call once it is free: an
+ * edited page that left RAM, unless the save in progress still has to copy
+ * the record it replaces, then the pages of the save, then the song; call
+ * from loop()
+ */
+void continueSave()
+{
+  if (patternStore.busy())
+  {
+    patternStore.carryOn();
+    return;
+  }
+  for (uint8_t page = 0; page < PATTERN_PAGE_MAX; page++)
+    if ((outQueued & _BV(page)) && !savesFrom(STORE_WORK + page))
+    {
+      writeOut(page);
+      return;
+    }
+  if (saveTo != STORE_NONE)
+    savePage();
+  else if (songPending)
+  {
+    songPending = false;
+    patternStore.save(STORE_SONG, song.bytes(), sizeof(Song));
+  }
+}
+
+/** writes everything waiting for the store, waiting for it in turn */
+void finishSave()
+{
+  while (outQueued || saveTo != STORE_NONE || songPending)
+    continueSave();
+}
+
+/**
+ * Brings the page holding a step into RAM, queueing the page there for its
+ * work record if it was edited; never waits for the store
+ * @param step 0..PATTERN_STEP_MAX - 1
+ */
+void turnPage(uint8_t step)
+{
+  uint8_t page = step / PAGE_STEPS;
+  if (page == pattern.page || page >= PATTERN_PAGE_MAX)
+    return;
+
+  if (pageEdited)
+  {
+    pattern.pack(outPage[pattern.page]);
+    outQueued |= _BV(pattern.page);
+    pageFrom[pattern.page] = STORE_WORK + pattern.page;
+    pageEdited = false;
+  }
+
+  uint8_t packed[PATTERN_PACKED];
+  readPage(page, packed);
+  pattern.unpackSteps(packed);
+  pattern.page = page;
+}
+
+/** true while a pattern save, or an edited page it would read, is being written */
+bool savingPattern() { return saveTo != STORE_NONE || outQueued; }
+
+/**
+ * Queues the pattern playing for the EEPROM, written in the background a
+ * page at a time. The first page, with the length, goes last, so a save
+ * cut short keeps the length it replaces.
+ * @return false while savingPattern(), or, writing nothing, if the store has
+ * no room for all of its pages
+ */
+bool savePattern(uint8_t inBank, uint8_t toSlot)
+{
+  if (savingPattern())
+    return false;
+
+  // a page without a record takes a slot, one replacing a record takes one
+  // until the old copy is let go
+  uint8_t slot = inBank * PATTERN_MAX + toSlot;
+  uint8_t pages = patternPages(pattern.length);
+  uint8_t fresh = 0;
+  for (uint8_t page = 0; page < pages; page++)
+    fresh += !patternStore.has(PatternStore::pageId(slot, page));
+  if (patternStore.spare() < fresh + (fresh < pages))
+    return false;
+
+  saveTo = slot;
+  savePages = pages;
+  memcpy(saveFrom, pageFrom, sizeof(saveFrom));
+  pattern.pack(saveHot);
+  saveHotPage = pattern.page;
+  saveStale = 0;
+  continueSave();
+  return true;
+}
+
+/**
+ * Makes a pattern read with readPattern() the one playing, its pages read
+ * from its own records. A save in progress carries on from its own copy.
+ * @param slot bank * PATTERN_MAX + pattern
+ */
+void openPattern(uint8_t slot)
+{
+  saveStale = 0xFF;
+  for (uint8_t page = 0; page < PATTERN_PAGE_MAX; page++)
+  {
+    uint8_t was = pageFrom[page];
+    pageFrom[page] = PatternStore::pageId(slot, page);
+    dropWork(was);
+  }
+  pageEdited = false;
+}
+
+// leaves the pattern unchanged if the slot was never saved
+void loadPattern(uint8_t inBank, uint8_t fromSlot)
+{
+  uint8_t slot = inBank * PATTERN_MAX + fromSlot;
+  readPattern(slot, pattern);
+  openPattern(slot);
+}
+
+// queues the song for the EEPROM, written in the background by continueSave()
+void saveSong()
+{
+  songPending = true;
+  continueSave();
+}
+
+// an empty song if none was saved
+void loadSong()
+{
+  if (!patternStore.load(STORE_SONG, song.bytes(), sizeof(Song)) || !song.isValid())
+    song = Song();
 }
 
 #endif
\ No newline at end of file
@@ -3,16 +3,36 @@
 
 #include <Arduino.h>
 
+const uint8_t BANK_MAX = 4;          // number of pattern banks
 const uint8_t PATTERN_MAX = 8;       // number of patterns
-const uint8_t PATTERN_STEP_MAX = 16; // number of steps per pattern
+const uint8_t PATTERN_STEP_MAX = 64; // number of steps per pattern
+const uint8_t PAGE_STEPS = 16;       // steps per page, of which the RAM holds one
+const uint8_t PATTERN_PAGE_MAX = PATTERN_STEP_MAX / PAGE_STEPS;
 
+// Stored patterns are packed a page at a time: a header byte with the format
+// version in the top two bits and length - 1 in the low six, the shuffle,
+// then a byte per step holding the note in the low 7 bits and the tie in the
+// top bit, note 0x7F being a rest. Version 2 had the version in the high
+// nibble and length - 1 in the low one, for up to 16 steps, and is still
+// read. Version 1 was the struct copied byte for byte.
+const uint8_t PATTERN_FORMAT = 3;
+const uint8_t PATTERN_PACKED = 2 + PAGE_STEPS; // bytes
+const uint8_t PATTERN_RAW = 22;                       // bytes of a version 1 pattern
+const uint8_t PACKED_TIE = 0x80;
+const uint8_t PACKED_REST = 0x7F;
+
+inline uint8_t patternPages(uint8_t length) { return (length + PAGE_STEPS - 1) / PAGE_STEPS; }
+
+// A pattern with the steps of one page; note, tie and rest positions are
+// within that page
 struct Pattern
 {
-  uint8_t note[16];
+  uint8_t note[PAGE_STEPS];
   uint16_t tieData;
   uint16_t restData;
   uint8_t length=16;
   uint8_t shuffle=50;
+  uint8_t page=0; // the page held in note, tieData and restData
   bool getTie(uint8_t position) { return bitRead(tieData, position); }
   void setTie(uint8_t position, bool isTie = true)
   {
@@ -29,33 +49,91 @@ struct Pattern
     else
       bitClear(restData, position);
   }
-  uint8_t *bytes() { return (uint8_t *)this; }
-  static Pattern fromBytes(uint8_t *data)
+
+  // the length in a packed header, 0 for an unknown format version
+  static uint8_t packedLength(uint8_t header)
   {
-    Pattern p = Pattern();
-    memcpy(&p, data, sizeof(Pattern));
-    return p;
+    if (header >> 6 == PATTERN_FORMAT)
+      return (header & 0x3F) + 1;
+    if (header >> 4 == 2)
+      return (header & 0x0F) + 1;
+    return 0;
   }
-};
 
-uint8_t *patternToBytes(Pattern *pattern)
-{
-  return (uint8_t *)pattern;
-}
+  /** writes the header and the shuffle, the first two packed bytes */
+  void packHeader(uint8_t *out)
+  {
+    out[0] = PATTERN_FORMAT << 6 | ((length - 1) & 0x3F);
+    out[1] = shuffle;
+  }
 
-Pattern newPatternFromBytes(uint8_t *bytes)
-{
-  Pattern p;
-  uint8_t *data = (uint8_t *)&p;
-#if (LOGGING)
-  Serial.print("pattern size: ");
-  Serial.println(sizeof(Pattern));
-#endif
+  /**
+   * Writes the page in RAM in the packed format; a rest drops its note, and
+   * a step that is both rest and tie keeps the rest
+   * @param out PATTERN_PACKED bytes
+   */
+  void pack(uint8_t *out)
+  {
+    packHeader(out);
+    uint16_t ties = tieData, rests = restData;
+    for (uint8_t i = 0; i < PAGE_STEPS; i++, ties >>= 1, rests >>= 1)
+      out[2 + i] = (rests & 1) ? PACKED_REST : (note[i] & 0x7F) | ((ties & 1) ? PACKED_TIE : 0);
+  }
 
-  for (byte i = 0; i < sizeof(Pattern); i++)
-    data[i] = bytes[i];
+  /**
+   * Reads a pattern in the packed format
+   * @param in PATTERN_PACKED bytes
+   * @return false, leaving the pattern unchanged, for an unknown format version
+   */
+  bool unpack(const uint8_t *in)
+  {
+    uint8_t packed = packedLength(in[0]);
+    if (packed == 0)
+      return false;
+    length = packed;
+    shuffle = in[1];
+    unpackSteps(in);
+    return true;
+  }
+
+  /**
+   * Reads the steps of a page, leaving the header alone
+   * @param in PATTERN_PACKED bytes
+   */
+  void unpackSteps(const uint8_t *in)
+  {
+    tieData = restData = 0;
+    for (uint8_t i = 0; i < PAGE_STEPS; i++)
+    {
+      uint8_t step = in[2 + i];
+      uint16_t bit = (uint16_t)1 << i;
+      if ((step & 0x7F) == PACKED_REST)
+      {
+        note[i] = 0;
+        restData |= bit;
+      }
+      else
+      {
+        note[i] = step & 0x7F;
+        if (step & PACKED_TIE)
+          tieData |= bit;
+      }
+    }
+  }
 
-  return p;
-}
+  /**
+   * Reads a version 1 pattern: 16 notes, the tie and rest masks little
+   * endian, length and shuffle
+   * @param raw PATTERN_RAW bytes
+   */
+  void unpackRaw(const uint8_t *raw)
+  {
+    memcpy(note, raw, 16);
+    tieData = raw[16] | raw[17] << 8;
+    restData = raw[18] | raw[19] << 8;
+    length = constrain(raw[20], 1, PAGE_STEPS);
+    shuffle = raw[21];
+  }
+};
 
-#endif
\ No newline at end of file
+#endif
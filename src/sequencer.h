@@ -8,13 +8,21 @@
 #include "memory.h"
 #include "ShiftRegisterPWM.h"
 #include "SimpleTimer.h"
+#include "StepClock.h"
+#include "RingBuffer.h"
+#include "ClockTracker.h"
 #include "dialog.h"
 #include "uistate.h"
 
 #pragma region CONSTANTS / ENUMS
 
-const uint16_t MAXTEMPO = 8000;
-const float TEMPODIV = 80.0;
+const uint16_t MIN_BPM = 20;  // range of the tempo knob
+const uint16_t MAX_BPM = 500;
+
+// step light levels, see displayStep()
+const uint8_t STEP_LEVEL_NOTE = 12;              // the other notes of the page
+const uint8_t STEP_LEVEL_TIE = LED_LEVEL_DIMMED; // a note held into the next step
+const uint8_t STEP_LEVEL_REST = 96;              // the playhead on a rest
 
 enum PlayModes : uint8_t
 {
@@ -27,7 +35,14 @@ enum PlayModes : uint8_t
 PlayModes playMode = FORWARD;
 
 // EXTERNAL CLOCK
-uint32_t lastClockExt = 0;
+const uint32_t CLOCK_EXT_DEBOUNCE = 4000;    // microseconds
+const uint32_t CLOCK_EXT_TIMEOUT = 2000000;  // microseconds without a pulse before falling back to internal
+uint32_t lastClockExt = 0;                   // micros() of the last accepted pulse
+
+// external clock ratios: negative divides, positive multiplies
+const int8_t CLOCK_RATIOS[] = {-4, -3, -2, 1, 2, 4};
+const uint8_t CLOCK_RATIO_COUNT = sizeof(CLOCK_RATIOS);
+const uint8_t CLOCK_RATIO_X1 = 3;
 enum ClockMode
 {
   CLK_INTERNAL,
@@ -47,25 +62,134 @@ private:
   Note previousNote;
   Glide glide;
   bool isPaused = true;
-  short transpose = 0;
+  int8_t transpose = 0; // a single byte so the CV interrupt never sees it half written
+  int8_t songTranspose = 0; // of the song entry playing, on top of transpose
 
-  uint16_t bpm = 120;
+  uint32_t centiBpm = 12000; // beats per minute x 100
   uint8_t curveIndex = Glide::CurveType::CURVE_B;
-  float portamento = 0.2;
+  uint8_t portamento = 20; // % of the step spent gliding
 
-  uint8_t patternLength = 16;
+  uint8_t patternLength = 16; // up to PATTERN_STEP_MAX, over several pages
   short direction = 1;
+  uint8_t barStep = 0; // position in the pass, counted for the chaos modes
+
+  // the step the next beat plays, drawn a beat early so the main loop can
+  // read its page ahead; redrawn if the step, length or play mode it was
+  // drawn from changed meanwhile
+  short comingStep = -1;
+  short comingAfter;
+  uint8_t comingLength;
+  PlayModes comingMode;
+
+  Pattern cued;        // the first page of the next pattern, prefetched and waiting for the downbeat
+  uint8_t cuedSlot = 0; // bank * PATTERN_MAX + pattern of the cue
+  bool isCued = false;
+  short cuedStep = -1;  // the step it starts on, drawn early like comingStep
+  PlayModes cuedMode;
+  uint8_t shownPage = 0; // of the step lights
+
+  // song mode: each entry's pattern is cued at the start of the entry
+  // before it, on its last pass
+  bool songMode = false;
+  uint8_t songIndex = 0;  // entry playing
+  uint8_t cuedIndex = 0;  // entry waiting in the cue
+  uint8_t passesLeft = 0; // of the entry playing, after this one
+  bool entryDue = false;  // the next entry is to be cued by the main loop
 
   uint8_t gateLength = 10;
   uint8_t octave = 1;
 
   ShiftRegisterPWM *sreg;
 
-  uint16_t getBpmInMilliseconds() { return 60.0 / bpm * 1000; }
-  void setBpmInMilliseconds(uint32_t milliseconds) { bpmClock.timeout = milliseconds; }
+  ClockTracker clockTracker;
+  uint8_t clockRatioIndex = CLOCK_RATIO_X1;
+  uint8_t clockDivCount = 0;   // pulses since the last divided step
+  uint8_t subStepsLeft = 0;    // multiplied steps still due before the next pulse
+  uint32_t subStepLength = 0;  // microseconds
+  uint32_t nextSubStep = 0;    // micros()
+
+  // step timings in ms, indexed by shuffleNoteFlag where there are two
+  struct TimingPlan
+  {
+    uint16_t beat;
+    uint16_t step[2];
+    uint16_t gate[2];
+    uint16_t glide[2];
+    uint16_t keyGlide; // notes played from the keyboard glide over a whole beat
+  };
+  TimingPlan plan;
+  bool planDirty = true;
+  ClockMode planClockMode = CLK_INTERNAL;
+
+  /**
+   * Returns the step timings, recomputing them first if tempo, shuffle, gate
+   * length, glide time or the clock source changed since the last call
+   */
+  const TimingPlan &timing()
+  {
+    if (planDirty || planClockMode != clockMode)
+      updateTimingPlan();
+    return plan;
+  }
+
+  /**
+   * Pages in the step of the pattern playing
+   * @return its position in the page in RAM
+   */
+  uint8_t at(short step)
+  {
+    step = max(step, (short)0);
+    turnPage(step);
+    return step % PAGE_STEPS;
+  }
+
+  void updateTimingPlan()
+  {
+    uint16_t beat = getBpmInMilliseconds();
+    uint8_t shuffle = constrain(pattern.shuffle, 10, 90);
+    uint16_t maxGate = (uint32_t)beat * gateLength / 100;
+    maxGate = constrain(maxGate, 2, beat - 2);
+
+    plan.beat = beat;
+    plan.step[0] = ((uint32_t)beat * (100 - shuffle) + 50) / 100;
+    plan.step[1] = ((uint32_t)beat * shuffle + 50) / 100;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+      plan.gate[i] = min((uint32_t)plan.step[i] * gateLength / 100, (uint32_t)maxGate);
+      plan.glide[i] = (uint32_t)plan.step[i] * portamento / 100;
+    }
+    plan.keyGlide = (uint32_t)beat * portamento / 100;
+
+    planClockMode = clockMode;
+    planDirty = false;
+  }
+
+  // in external mode the beat is derived from the tracked clock, two steps per beat like the internal clock
+  uint16_t getBpmInMilliseconds()
+  {
+    if (clockMode == CLK_EXTERNAL && clockTracker.isLocked())
+      return getExternalStepLength() / 500;
+    return 6000000UL / centiBpm;
+  }
+
+  uint32_t getExternalStepLength()
+  {
+    int8_t ratio = getClockRatio();
+    return (ratio < 0) ? clockTracker.period() * -ratio : clockTracker.period() / ratio;
+  }
+
+  // even/odd step lengths for the step clock, split by the pattern's shuffle
+  void updateClockLengths()
+  {
+    uint32_t beat = StepClock::beatLength(centiBpm);
+    uint32_t even = (uint64_t)beat * (100 - constrain(pattern.shuffle, 10, 90)) / 100;
+    bpmClock.setLengths(even, beat - even);
+    planDirty = true;
+  }
 
 public:
-  SimpleTimer bpmClock = SimpleTimer();
+  StepClock bpmClock = StepClock();
+  RingBuffer<uint32_t, 8> clockEvents; // external clock pulse timestamps from the INT0 ISR
   SimpleTimer gateTimer = SimpleTimer();
   SimpleTimer clockLedTimer = SimpleTimer();
   SimpleTimer dialogTimer = SimpleTimer();
@@ -75,7 +199,15 @@ public:
     clockMode = CLK_INTERNAL;
     sreg = ShiftRegisterPWM::singleton;
     setBpm(120);
-    bpmClock.start(getShuffleTime());
+    bpmClock.start();
+  }
+
+  /**
+   * Starts the hardware step clock; call from setup()
+   */
+  void begin()
+  {
+    bpmClock.interrupt();
   }
 
   void setRecording(bool startRecording)
@@ -85,10 +217,11 @@ public:
       sreg->set(ledPLAY, ledFLASH);
       sreg->set(ledSHIFT, ledOFF);
       currentStep = 0;
+      barStep = 0;
       isPaused = true;
 
       sreg->clearSequenceLights();
-      sreg->set(currentStep % 16, LedState::ledON);
+      sreg->set(currentStep % LED_STEPS, LedState::ledON);
     }
     else
     {
@@ -98,18 +231,84 @@ public:
   }
 
   /**
-   * Converts beats/minute to milliseconds in order to update
-   * the Sequencer's BPM Clock timer
+   * Sets the tempo and retimes the step in progress to match
    * @param bpm specifies the beats per minute to set
    */
-  void setBpm(uint16_t bpm)
+  void setBpm(uint16_t bpm) { setTempo(bpm * 100UL); }
+
+  /**
+   * Sets the tempo to 1/100 BPM
+   * @param centiBpm specifies the beats per minute x 100
+   */
+  void setTempo(uint32_t centiBpm)
+  {
+    this->centiBpm = constrain(centiBpm, 2000, 100000);
+    updateClockLengths();
+  }
+  uint16_t getBpm() { return centiBpm / 100; }
+  uint32_t getTempo() { return centiBpm; }
+  void setGateLength(uint8_t value)
+  {
+    gateLength = value;
+    planDirty = true;
+  }
+
+  /**
+   * Sets how much of each step is spent gliding to the next note
+   * @param percent 0..100
+   */
+  void setGlideTime(uint8_t percent)
   {
-    bpmClock.timeout = 60.0 / bpm * 1000;
-    this->bpm = bpm;
+    portamento = min(percent, (uint8_t)100);
+    planDirty = true;
   }
-  uint16_t getBpm() { return bpm; }
-  void setGateLength(uint8_t value) { gateLength = value; }
-  void setGlideTime(float value) { portamento = value; }
+  /**
+   * Reads a pattern into the spare buffer; it replaces the playing one on
+   * the downbeat after the current pass ends, or at once while paused
+   * @param bank 0..BANK_MAX-1
+   * @param slot 0..PATTERN_MAX-1
+   * @return false if that pattern was never saved
+   */
+  bool cuePattern(uint8_t bank, uint8_t slot)
+  {
+    stopSong();
+    return cue(bank * PATTERN_MAX + slot);
+  }
+
+  bool hasCuedPattern() { return isCued; }
+
+  /**
+   * Plays the song from its first entry, in a loop. Its first pattern is
+   * cued like a loaded one; each following one is cued a pass before it
+   * plays, so the change lands on the downbeat.
+   * @return false if the song is empty
+   */
+  bool playSong()
+  {
+    if (song.length == 0)
+      return false;
+    songMode = true;
+    songIndex = song.length - 1;
+    cueNextEntry();
+    showSongMode();
+    return songMode;
+  }
+
+  /**
+   * Leaves song mode; the pattern playing carries on
+   */
+  void stopSong()
+  {
+    songMode = false;
+    entryDue = false;
+    songTranspose = 0;
+    isCued = false;
+    showSongMode();
+  }
+
+  bool isPlayingSong() { return songMode; }
+  uint8_t getSongEntry() { return songIndex; }
+
   void setPatternLength(int value)
   {
     patternLength = value;
@@ -133,7 +332,10 @@ public:
     #endif
 
     if (direction != 0)
+    {
       pattern.shuffle = constrain(pattern.shuffle + direction * 2, 10, 90);
+      updateClockLengths();
+    }
 
     #if (LOGGING)
     Serial.print(F("\tafter : "));
@@ -144,37 +346,106 @@ public:
   }
 
   uint8_t getShuffle() { return pattern.shuffle; }
-  void setShuffle(uint8_t newShuffle) { pattern.shuffle = constrain(newShuffle, 10, 90); }
+  void setShuffle(uint8_t newShuffle)
+  {
+    pattern.shuffle = constrain(newShuffle, 10, 90);
+    updateClockLengths();
+  }
 
   /* ---------------- CLOCK HANDLING  ----------------
     */
   void bpmClockTick()
   {
-    uint32_t elapsed = millis() - lastClockExt;
-    if (elapsed > 2000)
+    uint32_t elapsed = micros() - lastClockExt;
+    if (elapsed > CLOCK_EXT_TIMEOUT)
       clockMode = ClockMode::CLK_INTERNAL;
 
     internalClockTrigger();
   }
 
+  /**
+   * External clock interrupt handler: only timestamps the pulse, which
+   * update() plays from the main loop
+   */
   void externalClockTrigger()
+  {
+    clockEvents.push(micros());
+  }
+
+  void externalClockPulse(uint32_t at)
   {
     clockMode = ClockMode::CLK_EXTERNAL;
 
-    uint32_t now = millis();
-    uint32_t elapsed = now - lastClockExt;
+    uint32_t elapsed = at - lastClockExt;
 
-    if (elapsed > 4)
+    if (elapsed > CLOCK_EXT_DEBOUNCE)
     {
-      lastClockExt = now;
-      beatFrom(CLK_EXTERNAL);
-      setBpmInMilliseconds(elapsed);
+      if (elapsed > CLOCK_EXT_TIMEOUT)
+      {
+        clockTracker.reset();
+        clockDivCount = 0;
+      }
+      lastClockExt = at;
+      clockTracker.pulse(at);
+      planDirty = true;
+      externalStep(at);
     }
 
-    if (elapsed > 2000)
+    if (elapsed > CLOCK_EXT_TIMEOUT)
       clockMode = ClockMode::CLK_INTERNAL;
   }
 
+  // plays the steps due on an external pulse according to the clock ratio
+  void externalStep(uint32_t at)
+  {
+    int8_t ratio = getClockRatio();
+    subStepsLeft = 0; // a pulse always resyncs, dropping multiplied steps not yet played
+
+    if (ratio < 0)
+    {
+      if (clockDivCount++ % -ratio == 0)
+        beatFrom(CLK_EXTERNAL);
+      return;
+    }
+
+    beatFrom(CLK_EXTERNAL);
+    if (ratio > 1 && clockTracker.isLocked())
+    {
+      subStepLength = clockTracker.period() / ratio;
+      subStepsLeft = ratio - 1;
+      nextSubStep = at + subStepLength;
+    }
+  }
+
+  // multiplied steps between external pulses, scheduled from the pulse time so they do not drift
+  void externalSubStep()
+  {
+    if (subStepsLeft && (int32_t)(micros() - nextSubStep) >= 0)
+    {
+      subStepsLeft--;
+      nextSubStep += subStepLength;
+      beatFrom(CLK_EXTERNAL);
+    }
+  }
+
+  int8_t getClockRatio() { return CLOCK_RATIOS[clockRatioIndex]; }
+
+  /**
+   * Steps through the external clock ratios /4 /3 /2 x1 x2 x4
+   * @param direction -1, 0 or 1
+   * @return index of the selected ratio
+   */
+  uint8_t changeClockRatio(int8_t direction)
+  {
+    if (direction != 0)
+    {
+      clockRatioIndex = constrain(clockRatioIndex + direction, 0, CLOCK_RATIO_COUNT - 1);
+      clockDivCount = 0;
+      planDirty = true;
+    }
+    return clockRatioIndex;
+  }
+
   void internalClockTrigger()
   {
     beatFrom(CLK_INTERNAL);
@@ -197,24 +468,18 @@ public:
     sreg->set(outClock, ledOFF);
   }
 
-  inline uint32_t getShuffleTime()
-  {
-    uint32_t shuffle = round(getBpmInMilliseconds() * (abs(-1.0 * (shuffleNoteFlag % 2) + (100-pattern.shuffle) / 100.0)));
-    return shuffle;
-  }
+  inline uint32_t getShuffleTime() { return timing().step[shuffleNoteFlag % 2]; }
 
   void openGate()
   {
-    uint32_t time = constrain(gateLength / 100.0 * getBpmInMilliseconds(), 2, getBpmInMilliseconds() - 2);
-
-    gateTimer.start(min(gateLength / 100.0 * getShuffleTime(), time));
+    gateTimer.start(timing().gate[shuffleNoteFlag % 2]);
     sreg->set(outGate, ledON);
     sreg->set(ledGate, ledON);
   }
 
   void closeGate()
   {
-    if (!pattern.getTie(currentStep))
+    if (!pattern.getTie(at(currentStep)))
     {
       sreg->set(outGate, ledOFF);
       sreg->set(ledGate, ledOFF);
@@ -231,6 +496,7 @@ public:
   void play()
   {
     shuffleNoteFlag = (currentStep+1) % 2;
+    bpmClock.setOdd(shuffleNoteFlag);
     isPaused = false;
     ShiftRegisterPWM::singleton->set(ledPLAY, ledON);
   }
@@ -259,40 +525,197 @@ public:
   void setValuePicker(int16_t value, int16_t low, int16_t high, bool timed = true, uint16_t ms = DIALOG_TIMEOUT)
   {    
     dialog.setDisplayValue(value, low, high, timed, ms);
-    dialog.writeoutDisplayBuffer(&ioData, &ioFlashData);
-    dialog.show();
   }
 
   void flashStep()
   {
-    sreg->set(currentStep % 16, LedState::ledFLASH);
+    sreg->flashTransient(currentStep % LED_STEPS);
   }
 
   void dimStep()
   {
-    sreg->setBrightness(currentStep % 16, ShiftRegisterPWM::Brightness::DIMMED);
+    sreg->setLevel(currentStep % LED_STEPS, STEP_LEVEL_TIE);
   }
 
+  /**
+   * The step layer keeps following the playhead under an open dialog. The
+   * playhead is lit at full, or at STEP_LEVEL_REST on a rest, over the notes
+   * of its page: faint, ties brighter so a held note reads as one, rests
+   * dark. A pattern longer than the step lights is shown a page of
+   * LED_STEPS at a time; as the playhead moves to another page, as many
+   * lights flash as the page's number.
+   */
   void displayStep()
   {
-    if (!dialog.isVisible())
+    sreg->clearSequenceLights();
+    short first = max(currentStep, (short)0) / PAGE_STEPS * PAGE_STEPS;
+    for (short step = first; step < first + PAGE_STEPS && step < patternLength; step++)
     {
-      sreg->clearSequenceLights();
-      LedState state = (currentNote.isRest) ? LedState::ledFLASH : LedState::ledON;
-      if (currentNote.isTie)
-      {
-        state = LedState::ledON;
-        sreg->setBrightness(currentStep, ShiftRegisterPWM::Brightness::DIMMED);
-      }
-      sreg->set(currentStep % 16, state);
+      uint8_t i = at(step);
+      if (pattern.getRest(i))
+        continue;
+      sreg->setLevel(step % LED_STEPS, pattern.getTie(i) ? STEP_LEVEL_TIE : STEP_LEVEL_NOTE);
+      sreg->set(step % LED_STEPS, ledON);
+    }
+    uint8_t playhead = max(currentStep, (short)0) % LED_STEPS;
+    sreg->setLevel(playhead, pattern.getRest(at(currentStep)) ? STEP_LEVEL_REST : LED_LEVEL_FULL);
+    sreg->set(playhead, ledON);
+
+    uint8_t page = max(currentStep, (short)0) / LED_STEPS;
+    if (page != shownPage)
+    {
+      shownPage = page;
+      for (uint8_t i = 0; i <= page; i++)
+        sreg->flashTransient(i);
     }
   }
 
+  /**
+   * Whether a step is the first of a pass through the pattern, where a cued
+   * pattern takes over. The chaos modes have no order, so a pass there is
+   * patternLength steps.
+   * @param bar the position in the pass the step is played at, see barStep
+   */
+  bool startsPass(uint8_t step, uint8_t bar)
+  {
+    switch (playMode)
+    {
+    case REVERSE:
+      return step == patternLength - 1;
+    case CHAOS:
+    case CHAOS_CURVES:
+      return bar == 0;
+    default:
+      return step == 0;
+    }
+  }
+
+  // the step the next beat plays, see comingStep
+  uint8_t stepComing()
+  {
+    if (comingStep < 0 || comingAfter != currentStep || comingLength != patternLength || comingMode != playMode)
+    {
+      comingAfter = currentStep;
+      comingLength = patternLength;
+      comingMode = playMode;
+      comingStep = nextStep(currentStep);
+    }
+    return comingStep;
+  }
+
+  // the step the cued pattern starts on
+  uint8_t cuedStart()
+  {
+    if (cuedStep < 0 || cuedMode != playMode)
+    {
+      cuedMode = playMode;
+      if (cued.length <= 1)
+        cuedStep = 0;
+      else if (playMode == REVERSE)
+        cuedStep = cued.length - 1;
+      else if (playMode == CHAOS || playMode == CHAOS_CURVES)
+        cuedStep = random(0, cued.length);
+      else
+        cuedStep = 0;
+    }
+    return cuedStep;
+  }
+
+  /**
+   * The store id of the page the next beat plays from, for the main loop to
+   * read ahead; STORE_NONE if that page is in RAM already or comes with the cue
+   */
+  uint8_t pageAhead()
+  {
+    uint8_t step = stepComing();
+    if (isCued && startsPass(step, (barStep + 1) % max(patternLength, (uint8_t)1)))
+    {
+      uint8_t page = cuedStart() / PAGE_STEPS;
+      return page ? PatternStore::pageId(cuedSlot, page) : STORE_NONE;
+    }
+    uint8_t page = step / PAGE_STEPS;
+    return page == pattern.page ? STORE_NONE : pageFrom[page];
+  }
+
+  /**
+   * Makes the cued pattern the live one; the next step is its first
+   */
+  void swapPattern()
+  {
+    pattern = cued;
+    openPattern(cuedSlot);
+    isCued = false;
+    if (songMode)
+    {
+      songIndex = cuedIndex;
+      passesLeft = song.entry[songIndex].getRepeats();
+      songTranspose = song.entry[songIndex].transpose;
+    }
+    setPatternLength(pattern.length);
+    setShuffle(pattern.shuffle);
+    direction = 1;
+    currentStep = -1;
+    barStep = 0;
+  }
+
+  /**
+   * Reads the first page of a pattern into the cue
+   * @param slot bank * PATTERN_MAX + pattern
+   */
+  bool cue(uint8_t slot)
+  {
+    if (!readPattern(slot, cued))
+      return false;
+    cuedSlot = slot;
+    isCued = true;
+    cuedStep = -1;
+    if (isPaused)
+      swapPattern();
+    return true;
+  }
+
+  // cues the song entry after the one playing, skipping patterns never saved
+  void cueNextEntry()
+  {
+    for (uint8_t i = 1; i <= song.length; i++)
+    {
+      uint8_t next = (songIndex + i) % song.length;
+      cuedIndex = next;
+      if (cue(song.entry[next].getSlot()))
+        return;
+    }
+    songMode = false;
+    showSongMode();
+  }
+
+  // the play light breathes while a song plays
+  void showSongMode()
+  {
+    sreg->setAnimation(ledPLAY, songMode ? ShiftRegisterPWM::BREATHE : ShiftRegisterPWM::STEADY);
+  }
+
+  // at the first step of every pass
+  void nextPass()
+  {
+    if (isCued)
+    {
+      uint8_t first = cuedStart();
+      swapPattern();
+      currentStep = first;
+    }
+    if (songMode && passesLeft > 0 && --passesLeft == 0)
+      entryDue = true; // read by the main loop, not on the beat
+  }
+
   void beat()
   {
     if (!isPaused)
     {
-      currentStep = nextStep(currentStep);
+      currentStep = stepComing();
+      comingStep = -1;
+      barStep = (barStep + 1) % max(patternLength, (uint8_t)1);
+      if (startsPass(currentStep, barStep))
+        nextPass();
       playNote();
       displayStep();
     }
@@ -337,7 +760,7 @@ public:
     return retVal;
   }
 
-  int16_t getPitchCV() { return constrain(glide.getPitch() + transpose * 40, 0, 3850); }
+  int16_t getPitchCV() { return constrain(glide.getPitch() + (transpose + songTranspose) * 40, 0, 3850); }
 
   uint16_t pitchToVoltage(uint16_t oct, uint16_t note)
   {
@@ -359,7 +782,7 @@ public:
     uint8_t stepData = ((octave - 1) * 12) + keyPressed;
     note.midiNote = stepData + MIDI_OFFSET;
     note.isRest = false;
-    note.isTie = pattern.getTie(currentStep);
+    note.isTie = pattern.getTie(at(currentStep));
     note.octave = octave;
     note.pitch = keyPressed;
     note.voltage = pitchToVoltage(note.octave, note.pitch);
@@ -370,9 +793,10 @@ public:
   {
     Note note;
     note.stepNumber = atIndex;
-    uint8_t stepData = pattern.note[atIndex];
-    note.isRest = pattern.getRest(atIndex);
-    note.isTie = pattern.getTie(atIndex);
+    uint8_t i = at(atIndex);
+    uint8_t stepData = pattern.note[i];
+    note.isRest = pattern.getRest(i);
+    note.isTie = pattern.getTie(i);
     note.octave = (stepData / 12.0) + 1;
     note.pitch = (stepData % 12) + 1;
     note.midiNote = stepData + MIDI_OFFSET;
@@ -389,9 +813,11 @@ public:
 
   void setPatternNote(Note note)
   {
-    pattern.setRest(currentStep, note.isRest);
-    pattern.setTie(currentStep, note.isTie);
-    pattern.note[currentStep] = note.pitch + (note.octave - 1) * 12;
+    uint8_t i = at(currentStep);
+    pattern.setRest(i, note.isRest);
+    pattern.setTie(i, note.isTie);
+    pattern.note[i] = note.pitch + (note.octave - 1) * 12;
+    editPage();
   }
 
   // send MIDI message
@@ -421,7 +847,7 @@ public:
     {
       openGate();
 
-      glide.begin(getShuffleTime(), portamento, previousNote.voltage, currentNote.voltage);
+      glide.begin(timing().glide[shuffleNoteFlag % 2], previousNote.voltage, currentNote.voltage);
     }
 
     /* MIDImessage(100, note.midiNote, 120);       // TODO: MIDI
@@ -434,7 +860,7 @@ public:
     currentNote = getKeyboardNote(keyPressed);
 
     openGate();
-    glide.begin(this->getBpmInMilliseconds(), portamento, previousNote.voltage, currentNote.voltage);
+    glide.begin(timing().keyGlide, previousNote.voltage, currentNote.voltage);
 
     if (isStepEditing())
     {
@@ -448,35 +874,46 @@ public:
 
   void patternInsertRest()
   {
-    bool rest = !pattern.getRest(currentStep);
-    pattern.setRest(currentStep, rest);
-    pattern.setTie(currentStep, false);
+    uint8_t i = at(currentStep);
+    bool rest = !pattern.getRest(i);
+    pattern.setRest(i, rest);
+    pattern.setTie(i, false);
 
     if (rest)
-      pattern.note[currentStep] = 0;
+      pattern.note[i] = 0;
+    editPage();
     currentStep = nextStep(currentStep);
     displayStep();
   }
 
   void patternInsertTie()
   {
-    pattern.setTie(currentStep, !pattern.getTie(currentStep));
-    pattern.setRest(currentStep, false);
+    uint8_t i = at(currentStep);
+    pattern.setTie(i, !pattern.getTie(i));
+    pattern.setRest(i, false);
+    editPage();
     currentStep = nextStep(currentStep);
     displayStep();
   }
 
   void update()
   {
+    uint32_t pulseTime;
+    while (clockEvents.pop(pulseTime))
+      externalClockPulse(pulseTime);
+    externalSubStep();
+
+    // the EEPROM is read here, between the bytes of a save, never on the beat
+    if (entryDue && patternStore.readable())
+    {
+      entryDue = false;
+      cueNextEntry();
+    }
+    readAhead(pageAhead());
+
     if (bpmClock.done())
     {
       shuffleNoteFlag ^= 1;
-      uint32_t shuffleTime = getShuffleTime();
-      bpmClock.start(shuffleTime);
-#if (LOGGING)
-      //Serial.print(F("shuffle clock: "));
-      //Serial.println(shuffleTime);
-#endif
       bpmClockTick();
     }
 
@@ -487,8 +924,6 @@ public:
       clockLedOff();
 
     dialog.update();
-    if (dialog.didClose())
-      displayStep();
 
     ShiftRegisterPWM::singleton->flash();
   }
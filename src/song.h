@@ -0,0 +1,72 @@
+#ifndef MY_SONG
+#define MY_SONG
+
+#include <Arduino.h>
+#include "pattern.h"
+
+const uint8_t SONG_MAX = 8;        // entries in a song, which fits in one pattern record
+const uint8_t SONG_REPEAT_MAX = 8; // passes of an entry
+
+static_assert(BANK_MAX * PATTERN_MAX <= 32, "a song entry keeps the pattern in 5 bits");
+
+// one pattern of a song: which one, how many passes, and its transpose
+struct SongEntry
+{
+  uint8_t slotRepeats; // bank * PATTERN_MAX + pattern in the low 5 bits, passes - 1 in the top 3
+  int8_t transpose;    // semitones
+
+  uint8_t getSlot() { return slotRepeats & 0x1F; }
+  uint8_t getBank() { return getSlot() / PATTERN_MAX; }
+  uint8_t getPattern() { return getSlot() % PATTERN_MAX; }
+  uint8_t getRepeats() { return (slotRepeats >> 5) + 1; }
+  void setRepeats(uint8_t repeats) { slotRepeats = getSlot() | (constrain(repeats, 1, SONG_REPEAT_MAX) - 1) << 5; }
+};
+
+// an ordered chain of patterns, played in a loop
+struct Song
+{
+  uint8_t length = 0;
+  SongEntry entry[SONG_MAX];
+
+  /**
+   * Adds a pattern to the end of the song; the same pattern at the same
+   * transpose as the last entry plays that entry once more instead
+   * @return false if the song is full
+   */
+  bool append(uint8_t bank, uint8_t pattern, int8_t transpose)
+  {
+    uint8_t slot = bank * PATTERN_MAX + pattern;
+    if (length > 0)
+    {
+      SongEntry &last = entry[length - 1];
+      if (last.getSlot() == slot && last.transpose == transpose && last.getRepeats() < SONG_REPEAT_MAX)
+      {
+        last.setRepeats(last.getRepeats() + 1);
+        return true;
+      }
+    }
+    if (length >= SONG_MAX)
+      return false;
+    entry[length].slotRepeats = slot;
+    entry[length].transpose = transpose;
+    length++;
+    return true;
+  }
+
+  void clear() { length = 0; }
+
+  // false for a song read from an EEPROM that never held one
+  bool isValid()
+  {
+    if (length > SONG_MAX)
+      return false;
+    for (uint8_t i = 0; i < length; i++)
+      if (entry[i].getSlot() >= BANK_MAX * PATTERN_MAX)
+        return false;
+    return true;
+  }
+
+  uint8_t *bytes() { return (uint8_t *)this; }
+};
+
+#endif
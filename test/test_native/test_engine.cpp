@@ -0,0 +1,1121 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "SimClock.h"
+#include "ShiftRegisterPWM.h"
+#include "sequencer.h"
+#include "QuadratureDecoder.h"
+#include "controls.h"
+#include "knob.h"
+
+ShiftRegisterPWM sr;
+CvOutput cv;
+Sequencer seq;
+QuadratureDecoder encoders;
+
+uint16_t clockEdges = 0;
+uint64_t firstEdge = 0, lastEdge = 0;
+
+void externalClock() { seq.externalClockTrigger(); }
+int16_t pitchCV() { return seq.getPitchCV(); }
+
+/**
+ * Runs the sequencer for the given virtual time, calling update() every
+ * loopUs (+ up to loopJitterUs) microseconds, and counts clock out pulses
+ * along the way.
+ */
+void runFor(uint32_t ms, uint16_t loopUs = 100, uint16_t loopJitterUs = 0)
+{
+    uint64_t end = simTicks() + (uint64_t)ms * 1000 * SIM_TICKS_PER_US;
+    bool lastClock = bitRead(sr.getData(), outClock);
+    while (simTicks() < end)
+    {
+        seq.update();
+        continueSave();
+        bool clock = bitRead(sr.getData(), outClock);
+        if (clock && !lastClock)
+        {
+            if (clockEdges++ == 0)
+                firstEdge = simTicks();
+            lastEdge = simTicks();
+        }
+        lastClock = clock;
+        simAdvance(loopUs + (loopJitterUs ? random(loopJitterUs + 1) : 0));
+    }
+}
+
+// lets the clock LED pulse of the last step run out
+void clockLedOffAfterPulse() { runFor(10); }
+
+void setUp(void)
+{
+    clockEdges = 0;
+}
+
+void tearDown(void) {}
+
+void test_internal_clock_plays_two_steps_per_beat(void)
+{
+    seq.setBpm(120);
+    seq.setShuffle(50);
+    seq.play();
+    runFor(1000);
+    clockEdges = 0;
+    runFor(10000);
+    TEST_ASSERT_INT_WITHIN(1, 40, clockEdges);
+}
+
+void test_internal_clock_does_not_drift_under_loop_load(void)
+{
+    seq.setBpm(140);
+    runFor(1000);
+    clockEdges = 0;
+    runFor(60000, 300, 3000);
+
+    // 140 BPM at 50% shuffle is 214285.7 us per step; lateness of any single
+    // step is bounded by one loop pass and must not accumulate
+    uint32_t measured = (lastEdge - firstEdge) / SIM_TICKS_PER_US;
+    uint32_t ideal = (clockEdges - 1) * 214285.7;
+    TEST_ASSERT_INT_WITHIN(3300, ideal, measured);
+    TEST_ASSERT_INT_WITHIN(1, 280, clockEdges);
+}
+
+void test_gate_length_follows_shuffled_step(void)
+{
+    seq.setBpm(120);
+    seq.setShuffle(70);
+    seq.setGateLength(50);
+    runFor(1000);
+
+    // 500 ms beat split 150/350 ms, gates at half of each step
+    uint32_t shortest = UINT32_MAX, longest = 0;
+    uint64_t opened = 0;
+    bool lastGate = bitRead(sr.getData(), outGate);
+    uint64_t end = simTicks() + 5000000ULL * SIM_TICKS_PER_US;
+    while (simTicks() < end)
+    {
+        seq.update();
+        bool gate = bitRead(sr.getData(), outGate);
+        if (gate && !lastGate)
+            opened = simTicks();
+        if (!gate && lastGate && opened)
+        {
+            uint32_t length = (simTicks() - opened) / SIM_TICKS_PER_US / 1000;
+            shortest = min(shortest, length);
+            longest = max(longest, length);
+        }
+        lastGate = gate;
+        simAdvance(100);
+    }
+    TEST_ASSERT_INT_WITHIN(2, 75, shortest);
+    TEST_ASSERT_INT_WITHIN(2, 175, longest);
+
+    seq.setShuffle(50);
+    seq.setGateLength(10);
+}
+
+void test_external_clock_plays_a_step_per_pulse(void)
+{
+    attachInterrupt(digitalPinToInterrupt(CLK_IN), externalClock, RISING);
+    simExternalClock(100);
+    runFor(1500); // the first pulse after a long gap only restarts the interval
+
+    clockEdges = 0;
+    runFor(6000);
+    TEST_ASSERT_INT_WITHIN(1, 10, clockEdges);
+    TEST_ASSERT_EQUAL(CLK_EXTERNAL, clockMode);
+
+    simExternalClock(0);
+    runFor(3000);
+    TEST_ASSERT_EQUAL(CLK_INTERNAL, clockMode);
+}
+
+void test_external_clock_isr_only_queues_the_pulse(void)
+{
+    simExternalClock(0);
+    seq.update();
+    clockLedOffAfterPulse();
+
+    simSetPin(CLK_IN, HIGH);
+    TEST_ASSERT_EQUAL(1, seq.clockEvents.count());
+    TEST_ASSERT_FALSE(bitRead(sr.getData(), outClock));
+
+    seq.update();
+    TEST_ASSERT_TRUE(seq.clockEvents.isEmpty());
+    TEST_ASSERT_TRUE(bitRead(sr.getData(), outClock));
+    simSetPin(CLK_IN, LOW);
+}
+
+void test_external_clock_ratios(void)
+{
+    static const uint8_t expected[CLOCK_RATIO_COUNT] = {3, 4, 6, 12, 24, 48};
+
+    attachInterrupt(digitalPinToInterrupt(CLK_IN), externalClock, RISING);
+    simExternalClock(120, 500);
+    runFor(1500);
+
+    seq.changeClockRatio(-CLOCK_RATIO_X1);
+    for (uint8_t i = 0; i < CLOCK_RATIO_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(i, seq.changeClockRatio(i ? 1 : 0));
+        runFor(600); // new ratio takes effect from the next pulse
+        clockEdges = 0;
+        runFor(6000);
+        TEST_ASSERT_INT_WITHIN(1, expected[i], clockEdges);
+    }
+
+    TEST_ASSERT_EQUAL(CLOCK_RATIO_X1, seq.changeClockRatio(-2));
+    simExternalClock(0);
+    runFor(3000);
+}
+
+void test_clock_tracker_rejects_a_single_jittery_pulse(void)
+{
+    ClockTracker tracker;
+    uint32_t at = 0;
+    for (uint8_t i = 0; i < 6; i++)
+        tracker.pulse(at += 500000);
+    tracker.pulse(at += 350000);
+    TEST_ASSERT_EQUAL(500000, tracker.period());
+    tracker.pulse(at += 150000);
+    TEST_ASSERT_EQUAL(500000, tracker.period());
+    TEST_ASSERT_EQUAL(at + 500000, tracker.predictNext());
+
+    // a real tempo change is followed within three pulses
+    tracker.pulse(at += 400000);
+    tracker.pulse(at += 400000);
+    tracker.pulse(at += 400000);
+    TEST_ASSERT_EQUAL(400000, tracker.period());
+}
+
+void test_glide_follows_curve(void)
+{
+    Glide glide;
+    glide.setCurve(Glide::CURVE_C);
+    glide.begin(100, 1000, 2000);
+    TEST_ASSERT_INT_WITHIN(40, 1000, glide.getPitch());
+    simAdvance(50000);
+    TEST_ASSERT_INT_WITHIN(20, 1500, glide.getPitch());
+    simAdvance(50000);
+    TEST_ASSERT_EQUAL(2000, glide.getPitch());
+
+    // falling glides scale the curve the other way
+    glide.begin(100, 2000, 1000);
+    simAdvance(50000);
+    TEST_ASSERT_INT_WITHIN(20, 1500, glide.getPitch());
+
+    // CURVE_D holds the first pitch until the glide time is up
+    glide.setCurve(Glide::CURVE_D);
+    glide.begin(100, 1000, 2000);
+    simAdvance(99000);
+    TEST_ASSERT_EQUAL(1000, glide.getPitch());
+    simAdvance(1000);
+    TEST_ASSERT_EQUAL(2000, glide.getPitch());
+}
+
+void test_cv_output_rate_ignores_loop_load(void)
+{
+    // a loop pass of 20 ms would have meant 50 CV updates per second
+    uint32_t before = cv.dac.writesIssued + cv.dac.writesSkipped;
+    runFor(1000, 20000);
+    TEST_ASSERT_INT_WITHIN(1, CV_RATE, cv.dac.writesIssued + cv.dac.writesSkipped - before);
+}
+
+void test_dac_skips_unchanged_words(void)
+{
+    MP4822 dac;
+    uint32_t before = simStats.dacWrites[1];
+    dac.DAC_set(1, 2000);
+    dac.DAC_set(1, 2000);
+    dac.DAC_set(1, 2001);
+    TEST_ASSERT_EQUAL(before + 2, simStats.dacWrites[1]);
+    TEST_ASSERT_EQUAL(2001, simStats.dacValue[1]);
+    TEST_ASSERT_EQUAL(2, dac.writesIssued);
+    TEST_ASSERT_EQUAL(1, dac.writesSkipped);
+
+    dac.invalidate();
+    dac.DAC_set(1, 2001);
+    TEST_ASSERT_EQUAL(before + 3, simStats.dacWrites[1]);
+}
+
+void test_dac_latches_both_channels_together(void)
+{
+    MP4822 dac;
+    dac.DAC_set(0, 100);
+    dac.DAC_set(1, 200);
+    uint64_t latches = simStats.dacLatches;
+    dac.stage(0, 1000);
+    dac.stage(1, 3000);
+    TEST_ASSERT_EQUAL(100, simStats.dacValue[0]);
+    TEST_ASSERT_EQUAL(200, simStats.dacValue[1]);
+    dac.latch();
+    TEST_ASSERT_EQUAL(1000, simStats.dacValue[0]);
+    TEST_ASSERT_EQUAL(3000, simStats.dacValue[1]);
+#if (DAC_LDAC_LATCH)
+    TEST_ASSERT_EQUAL(latches + 1, simStats.dacLatches);
+#else
+    TEST_ASSERT_EQUAL(latches, simStats.dacLatches); // LDAC stays tied low
+#endif
+
+    // an unchanged channel is left off the bus
+    uint64_t words = simStats.dacWrites[0] + simStats.dacWrites[1];
+    dac.stage(0, 1000);
+    dac.stage(1, 3001);
+    dac.latch();
+    TEST_ASSERT_EQUAL(words + 1, simStats.dacWrites[0] + simStats.dacWrites[1]);
+}
+
+void test_bcm_shows_brightness_in_eight_interrupts_per_frame(void)
+{
+    const uint8_t led = 20;
+    sr.setPulseWidth(100);
+    sr.set(led, ledON);
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+    runFor(100);
+
+    uint64_t isrCalls = simStats.isrCalls[SIM_ISR_TIMER1_COMPA];
+    uint64_t onTicks = simStats.srOnTicks[led];
+    uint64_t from = simStats.srLastLatch;
+    runFor(1000);
+    uint64_t on = simStats.srOnTicks[led] - onTicks;
+    uint64_t total = simStats.srLastLatch - from;
+
+    TEST_ASSERT_INT_WITHIN(8, 1004, simStats.isrCalls[SIM_ISR_TIMER1_COMPA] - isrCalls);
+    uint8_t level = (255 * 100 + 255) >> 8;
+    TEST_ASSERT_INT_WITHIN(5, 1000 * pgm_read_byte_near(ledGamma + level) / 255, 1000 * on / total);
+
+    // outputs do not wait for the bitplane to end
+    sr.set(outGate, ledON);
+    TEST_ASSERT_TRUE(bitRead(simStats.srOutputs, outGate));
+    sr.set(outGate, ledOFF);
+    TEST_ASSERT_FALSE(bitRead(simStats.srOutputs, outGate));
+
+    TIMSK1 = 0;
+    sr.set(led, ledOFF);
+    sr.setPulseWidth(255);
+}
+
+void test_bcm_keeps_its_timing_when_the_isr_is_entered_late(void)
+{
+    const uint8_t led = 20, dim = 21;
+    sr.set(led, ledON);
+    sr.set(dim, ledON);
+    sr.setLevel(dim, 20); // lit for the first plane only
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+    simSetTimer1Latency(600); // the step clock interrupt ran first
+    runFor(100);
+
+    uint64_t isrCalls = simStats.isrCalls[SIM_ISR_TIMER1_COMPA];
+    uint64_t onTicks[2] = {simStats.srOnTicks[led], simStats.srOnTicks[dim]};
+    uint64_t from = simStats.srLastLatch;
+    runFor(1000);
+    uint64_t total = simStats.srLastLatch - from;
+
+    // no plane is missed and left up for a whole turn of the counter
+    TEST_ASSERT_INT_WITHIN(8, 1004, simStats.isrCalls[SIM_ISR_TIMER1_COMPA] - isrCalls);
+    TEST_ASSERT_INT_WITHIN(5, 1000, 1000 * (simStats.srOnTicks[led] - onTicks[0]) / total);
+    TEST_ASSERT_EQUAL(1, pgm_read_byte_near(ledGamma + 20));
+    TEST_ASSERT_INT_WITHIN(5, 1000 / 255, 1000 * (simStats.srOnTicks[dim] - onTicks[1]) / total);
+
+    simSetTimer1Latency(0);
+    TIMSK1 = 0;
+    sr.setLevel(dim, LED_LEVEL_FULL);
+    sr.set(led, ledOFF);
+    sr.set(dim, ledOFF);
+}
+
+void test_leds_have_their_own_gamma_corrected_level(void)
+{
+    const uint8_t full = 20, dimmed = 21, half = 22;
+    sr.set(full, ledON);
+    sr.set(dimmed, ledON);
+    sr.set(half, ledON);
+    sr.setBrightness(dimmed, ShiftRegisterPWM::Brightness::DIMMED);
+    sr.setLevel(half, 128);
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+    runFor(100);
+
+    uint64_t onTicks[3] = {simStats.srOnTicks[full], simStats.srOnTicks[dimmed], simStats.srOnTicks[half]};
+    uint64_t from = simStats.srLastLatch;
+    runFor(1000);
+    uint64_t total = simStats.srLastLatch - from;
+
+    TEST_ASSERT_INT_WITHIN(5, 1000, 1000 * (simStats.srOnTicks[full] - onTicks[0]) / total);
+    TEST_ASSERT_INT_WITHIN(5, 1000 * pgm_read_byte_near(ledGamma + LED_LEVEL_DIMMED) / 255,
+                           1000 * (simStats.srOnTicks[dimmed] - onTicks[1]) / total);
+    TEST_ASSERT_INT_WITHIN(5, 1000 * pgm_read_byte_near(ledGamma + 128) / 255,
+                           1000 * (simStats.srOnTicks[half] - onTicks[2]) / total);
+
+    TIMSK1 = 0;
+    sr.clearSequenceLights();
+    sr.set(full, ledOFF);
+    sr.set(dimmed, ledOFF);
+    sr.set(half, ledOFF);
+    sr.setBrightness(dimmed, ShiftRegisterPWM::Brightness::FULL);
+    sr.setLevel(half, LED_LEVEL_FULL);
+}
+
+void test_led_changes_show_only_once_published(void)
+{
+    const uint8_t led = 20;
+    sr.publish();
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+    simAdvance(20000);
+    TEST_ASSERT_FALSE(bitRead(simStats.srOutputs, led));
+
+    sr.set(led, ledON);
+    simAdvance(20000);
+    TEST_ASSERT_FALSE(bitRead(simStats.srOutputs, led));
+
+    sr.publish();
+    simAdvance(20000);
+    TEST_ASSERT_TRUE(bitRead(simStats.srOutputs, led));
+
+    TIMSK1 = 0;
+    sr.set(led, ledOFF);
+    sr.publish();
+}
+
+void test_led_animations_run_without_the_loop(void)
+{
+    const uint8_t flashing = 20, oneShot = 21;
+    sr.set(flashing, ledFLASH);
+    sr.trigger(oneShot);
+    sr.publish();
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+
+    // nothing calls flash() from here on, the ISR still blinks at 3.9 Hz
+    uint8_t edges = 0;
+    bool lit = false;
+    for (uint16_t ms = 0; ms < 2000; ms++)
+    {
+        simAdvance(1000);
+        bool now = bitRead(simStats.srOutputs, flashing);
+        if (now && !lit)
+            edges++;
+        lit = now;
+    }
+    TEST_ASSERT_INT_WITHIN(1, 8, edges);
+
+    // the one-shot faded out once and stays dark
+    uint64_t onTicks = simStats.srOnTicks[oneShot];
+    simAdvance(1000000);
+    TEST_ASSERT_EQUAL(onTicks, simStats.srOnTicks[oneShot]);
+    TEST_ASSERT_TRUE(onTicks > 0);
+
+    // setting the pin again ends the one-shot, so it lights steadily
+    sr.set(oneShot, ledON);
+    sr.publish();
+    simAdvance(100000);
+    TEST_ASSERT_TRUE(simStats.srOnTicks[oneShot] > onTicks);
+    TEST_ASSERT_EQUAL(ShiftRegisterPWM::STEADY, sr.getAnimation(oneShot));
+
+    TIMSK1 = 0;
+    sr.set(flashing, ledOFF);
+    sr.set(oneShot, ledOFF);
+    sr.publish();
+}
+
+void test_dialog_overlay_leaves_the_step_layer_alone(void)
+{
+    const uint8_t step = 10, border = 15;
+    Dialog picker;
+    sr.set(step, ledON);
+    sr.interrupt(ShiftRegisterPWM::UpdateFrequency::BitCodeModulation);
+    sr.flash();
+    simAdvance(20000);
+    TEST_ASSERT_TRUE(bitRead(simStats.srOutputs, step));
+
+    picker.setDisplayValue(0, 0, 9, true, 100);
+    sr.flash();
+    simAdvance(20000);
+    TEST_ASSERT_FALSE(bitRead(simStats.srOutputs, step));
+    TEST_ASSERT_TRUE(bitRead(simStats.srOutputs, border));
+
+    // the step shows again as soon as the dialog closes, nothing redraws it
+    simAdvance(100000);
+    picker.update();
+    sr.flash();
+    simAdvance(20000);
+    TEST_ASSERT_TRUE(bitRead(simStats.srOutputs, step));
+    TEST_ASSERT_FALSE(bitRead(simStats.srOutputs, border));
+
+    TIMSK1 = 0;
+    sr.set(step, ledOFF);
+    sr.publish();
+}
+
+void test_step_lights_show_the_page_by_level(void)
+{
+    Pattern live = pattern;
+    pattern.setTie(1);
+    pattern.setRest(1, false);
+    pattern.setRest(2);
+    pattern.setTie(2, false);
+    pattern.setRest(0, false);
+    pattern.setTie(0, false);
+
+    seq.setStep(0);
+    seq.displayStep();
+    TEST_ASSERT_EQUAL(LED_LEVEL_FULL, sr.getLevel(0)); // the playhead
+    TEST_ASSERT_EQUAL(STEP_LEVEL_TIE, sr.getLevel(1));
+    TEST_ASSERT_FALSE(bitRead(sr.getData(), 2));       // a rest stays dark
+    TEST_ASSERT_EQUAL(STEP_LEVEL_NOTE, sr.getLevel(3));
+    TEST_ASSERT_FALSE(bitRead(sr.getFlashData(), 0));
+
+    seq.setStep(2);
+    seq.displayStep();
+    TEST_ASSERT_EQUAL(STEP_LEVEL_REST, sr.getLevel(2)); // the playhead on a rest, lit but not flashing
+    TEST_ASSERT_TRUE(bitRead(sr.getData(), 2));
+    TEST_ASSERT_FALSE(bitRead(sr.getFlashData(), 2));
+    TEST_ASSERT_EQUAL(STEP_LEVEL_NOTE, sr.getLevel(0));
+
+    pattern = live;
+    sr.clearSequenceLights();
+    sr.publish();
+}
+
+// turns knob 3 (A on D8, B on D9) by whole detents, one edge every 50 us
+void turnKnob3(int8_t detents)
+{
+    static const uint8_t clockwise[4][2] = {{0, 1}, {0, 0}, {1, 0}, {1, 1}}; // A, B
+    for (; detents; detents += (detents > 0) ? -1 : 1)
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            uint8_t edge = (detents > 0) ? i : (2 - i) & 3;
+            simSetPin(8, clockwise[edge][0]);
+            simSetPin(9, clockwise[edge][1]);
+            simAdvance(50);
+        }
+}
+
+void test_encoder_detents_are_counted_in_the_isr(void)
+{
+    encoders.take(2);
+    turnKnob3(20); // 4 ms, no loop in between
+    TEST_ASSERT_EQUAL(20, encoders.take(2));
+
+    turnKnob3(-5);
+    TEST_ASSERT_EQUAL(-5, encoders.take(2));
+
+    // a contact bounce that returns to the detent is not a step
+    simSetPin(8, LOW);
+    simSetPin(8, HIGH);
+    TEST_ASSERT_EQUAL(0, encoders.take(2));
+}
+
+void test_fast_turns_accelerate_the_tempo_knob(void)
+{
+    static KnobFunction modes[3] = {TempoAdjust, StepSelect, GateTime};
+    Knob tempo(2, encoderButtons);
+    tempo.addModes(modes);
+    tempo.setRange(ledOFF, 0, MIN_BPM, MAX_BPM);
+    tempo.setMode(0);
+    tempo.setValue(100);
+    tempo.update();
+
+    // slow turns stay precise, one BPM per detent
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        simAdvance(100000);
+        turnKnob3(1);
+        tempo.update();
+    }
+    TEST_ASSERT_EQUAL(105, tempo.value());
+
+    // a quick flick of 20 detents, 5 ms apart, covers most of the range
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        simAdvance(5000);
+        turnKnob3(1);
+        tempo.update();
+    }
+    TEST_ASSERT_TRUE(tempo.value() > 300);
+
+    // the other way, slowly, is one step per detent again
+    short fast = tempo.value();
+    simAdvance(100000);
+    turnKnob3(-1);
+    tempo.update();
+    TEST_ASSERT_EQUAL(fast - 1, tempo.value());
+    TEST_ASSERT_EQUAL(-1, tempo.direction());
+}
+
+void test_buttons_are_debounced_in_the_adc_isr(void)
+{
+    uint32_t now = millis();
+    simPressAnalog(BUTTONS_FUNC, FUNC_BUTTONS_VALUES[SAVE], now + 10, 40);
+    simPressAnalog(BUTTONS_FUNC, FUNC_BUTTONS_VALUES[LOAD], now + 100, 5); // a glitch
+    simAdvance(200000);                                                    // the loop is away
+
+    funcButtons.update();
+    TEST_ASSERT_TRUE(funcButtons.onPress(SAVE));
+    funcButtons.update();
+    TEST_ASSERT_TRUE(funcButtons.onRelease(SAVE));
+    funcButtons.update();
+    TEST_ASSERT_FALSE(funcButtons.onPress(LOAD));
+    TEST_ASSERT_FALSE(funcButtons.isPressed(LOAD));
+
+    // a ladder nobody reads keeps no presses for later
+    now = millis();
+    simPressAnalog(BUTTONS_KBD_WHITE, KBDW_BUTTONS_VALUES[3], now + 10, 40);
+    simAdvance(200000);
+    pianoWhite.flush();
+    pianoWhite.update();
+    TEST_ASSERT_FALSE(pianoWhite.onPress(3));
+    TEST_ASSERT_FALSE(pianoWhite.onRelease(3));
+    TEST_ASSERT_FALSE(pianoWhite.isPressed(3));
+}
+
+void test_pattern_saves_in_the_background(void)
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    patternStore.begin();
+    pattern.note[3] = 42;
+
+    uint64_t start = simTicks();
+    uint64_t writes = simStats.eepromWrites;
+    savePattern(1, 2);
+    TEST_ASSERT_EQUAL(start, simTicks()); // loop() is not held up
+    simAdvance(100000);                   // the EE_READY ISR writes the record
+    TEST_ASSERT_FALSE(patternStore.busy());
+    TEST_ASSERT_LESS_OR_EQUAL(STORE_RECORD, simStats.eepromWrites - writes);
+
+    // an unchanged pattern is not written, a changed one goes to the next slot
+    writes = simStats.eepromWrites;
+    savePattern(1, 2);
+    TEST_ASSERT_EQUAL(writes, simStats.eepromWrites);
+    pattern.note[3] = 43;
+    savePattern(1, 2);
+    simAdvance(100000);
+    TEST_ASSERT_EQUAL(42, EEPROM.data[2 + 3]); // the packed note of step 3
+    TEST_ASSERT_EQUAL(43, EEPROM.data[STORE_RECORD + 2 + 3]);
+
+    // after a power cycle the newest valid copy wins
+    pattern.note[3] = 0;
+    patternStore.begin();
+    loadPattern(1, 2);
+    TEST_ASSERT_EQUAL(43, pattern.note[3]);
+    EEPROM.data[STORE_RECORD + 2 + 3] ^= 1; // a save cut short
+    patternStore.begin();
+    loadPattern(1, 2);
+    TEST_ASSERT_EQUAL(42, pattern.note[3]);
+
+    // the next save rewrites only the bytes that differ from the stale copy
+    writes = simStats.eepromWrites;
+    pattern.note[3] = 43;
+    savePattern(1, 2);
+    simAdvance(100000);
+    TEST_ASSERT_LESS_OR_EQUAL(2, simStats.eepromWrites - writes);
+
+    // a save right after another waits in RAM instead of holding up loop()
+    pattern.note[3] = 41;
+    savePattern(1, 3);
+    start = simTicks();
+    saveSong();
+    TEST_ASSERT_LESS_THAN(start + 10 * SIM_TICKS_PER_US, simTicks());
+    TEST_ASSERT_TRUE(songPending);
+    finishSave();
+    TEST_ASSERT_FALSE(songPending);
+    simAdvance(100000);
+    memset(pattern.note, 0, sizeof(pattern.note));
+}
+
+// a layout 1 record: a version 1 pattern, id, sequence number and CRC-8
+void putV1Record(uint8_t slot, uint8_t id, uint8_t sequence, uint8_t firstNote)
+{
+    uint8_t *p = EEPROM.data + slot * STORE_V1_RECORD;
+    for (uint8_t i = 0; i < 16; i++)
+        p[i] = firstNote + i;
+    p[16] = 0x02; // tie on step 1
+    p[17] = 0;
+    p[18] = 0;
+    p[19] = 0x80; // rest on step 15
+    p[20] = 12;
+    p[21] = 58;
+    p[22] = id;
+    p[23] = sequence;
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < STORE_V1_RECORD - 1; i++)
+        crc = _crc_ibutton_update(crc, p[i]);
+    p[24] = crc;
+}
+
+void test_old_layouts_migrate_on_first_boot(void)
+{
+    Pattern p;
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    simSeedEeprom(); // bare patterns from before the store
+    patternStore.begin();
+    TEST_ASSERT_TRUE(readPattern(5, p));
+    TEST_ASSERT_EQUAL(95, p.note[15]);
+    TEST_ASSERT_EQUAL(16, p.length);
+    TEST_ASSERT_EQUAL(50, p.shuffle);
+    TEST_ASSERT_EQUAL(STORE_LAYOUT, EEPROM.data[E2END]);
+
+    // each flat pattern lands on its own bank and pattern
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    for (uint8_t index = 0; index < STORE_FLAT_PATTERNS; index++)
+    {
+        uint8_t *raw = EEPROM.data + index * PATTERN_RAW;
+        memset(raw, 0, PATTERN_RAW);
+        raw[0] = index; // the bank in the low 3 bits, the pattern above
+        raw[20] = 16;
+        raw[21] = 50;
+    }
+    patternStore.begin();
+    for (uint8_t bank = 0; bank < BANK_MAX; bank++)
+        for (uint8_t i = 0; i < PATTERN_MAX; i++)
+        {
+            bool stored = i * STORE_FLAT_STRIDE + bank < STORE_FLAT_PATTERNS;
+            TEST_ASSERT_EQUAL(stored, readPattern(bank * PATTERN_MAX + i, p));
+            if (stored)
+                TEST_ASSERT_EQUAL(i * STORE_FLAT_STRIDE + bank, p.note[0]);
+        }
+
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data)); // records of unpacked patterns
+    putV1Record(3, 7, 4, 30);
+    putV1Record(5, 7, 3, 20); // an older copy
+    patternStore.begin();
+    TEST_ASSERT_TRUE(readPattern(7, p));
+    TEST_ASSERT_EQUAL(30, p.note[0]);
+    TEST_ASSERT_TRUE(p.getTie(1));
+    TEST_ASSERT_TRUE(p.getRest(15));
+    TEST_ASSERT_EQUAL(12, p.length);
+    TEST_ASSERT_EQUAL(58, p.shuffle);
+    TEST_ASSERT_FALSE(readPattern(6, p));
+
+    // the packed format keeps every step
+    Pattern packed;
+    uint8_t bytes[PATTERN_PACKED];
+    p.pack(bytes);
+    TEST_ASSERT_TRUE(packed.unpack(bytes));
+    TEST_ASSERT_EQUAL_MEMORY(p.note, packed.note, 15);
+    TEST_ASSERT_EQUAL(p.tieData, packed.tieData);
+    TEST_ASSERT_EQUAL(p.restData, packed.restData);
+}
+
+void test_cued_pattern_switches_on_the_downbeat(void)
+{
+    Pattern live = pattern;
+    pattern.note[0] = 77;
+    pattern.length = 4;
+    savePattern(0, 1);
+    pattern = live;
+
+    seq.setBpm(120);
+    seq.setPatternLength(4);
+    seq.play();
+    while (seq.selectStep(0) != 1)
+        runFor(10);
+
+    TEST_ASSERT_TRUE(seq.cuePattern(0, 1));
+    TEST_ASSERT_EQUAL(live.note[0], pattern.note[0]); // the pass plays to its end
+    while (seq.selectStep(0) != 0)
+    {
+        TEST_ASSERT_TRUE(seq.hasCuedPattern());
+        runFor(10);
+    }
+    TEST_ASSERT_FALSE(seq.hasCuedPattern());
+    TEST_ASSERT_EQUAL(77, pattern.note[0]);
+
+    pattern = live;
+    seq.setPatternLength(16);
+    seq.pause();
+}
+
+void test_song_chains_patterns_on_the_downbeat(void)
+{
+    Pattern live = pattern;
+    pattern.length = 4;
+    pattern.note[0] = 11;
+    savePattern(0, 2);
+    pattern.note[0] = 22;
+    savePattern(0, 3);
+
+    song.clear();
+    song.append(0, 2, 0);
+    song.append(0, 2, 0); // the same pattern again plays it twice
+    song.append(0, 3, 5);
+    TEST_ASSERT_EQUAL(2, song.length);
+    saveSong();
+    finishSave();
+    song.clear();
+    loadSong();
+    TEST_ASSERT_EQUAL(2, song.length);
+
+    seq.setBpm(120);
+    TEST_ASSERT_TRUE(seq.playSong());
+    TEST_ASSERT_EQUAL(11, pattern.note[0]); // paused, so the first entry is there at once
+    TEST_ASSERT_EQUAL(ShiftRegisterPWM::BREATHE, sr.getAnimation(ledPLAY));
+    seq.play();
+
+    uint8_t passes[4];
+    bool cuedBeforeEnd[4]; // by the last step of each pass
+    short last = -1;
+    for (uint8_t pass = 0; pass < 4;)
+    {
+        runFor(10);
+        short step = seq.selectStep(0);
+        if (step == last)
+            continue;
+        if (step == 3 && pass > 0)
+            cuedBeforeEnd[pass - 1] = seq.hasCuedPattern();
+        if (step == 0)
+            passes[pass++] = pattern.note[0];
+        last = step;
+    }
+    TEST_ASSERT_EQUAL(11, passes[0]);
+    TEST_ASSERT_EQUAL(11, passes[1]);
+    TEST_ASSERT_EQUAL(22, passes[2]);
+    TEST_ASSERT_EQUAL(11, passes[3]); // the song loops
+    TEST_ASSERT_FALSE(cuedBeforeEnd[0]);
+    TEST_ASSERT_TRUE(cuedBeforeEnd[1]); // prefetched during the last pass of the entry
+    TEST_ASSERT_TRUE(cuedBeforeEnd[2]);
+
+    seq.stopSong();
+    TEST_ASSERT_EQUAL(ShiftRegisterPWM::STEADY, sr.getAnimation(ledPLAY));
+    seq.pause();
+    pattern = live;
+    seq.setPatternLength(16);
+}
+
+void test_long_patterns_play_a_page_at_a_time(void)
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    patternStore.begin();
+    Pattern live = pattern;
+    openPattern(STORE_PATTERNS - 1);
+    TEST_ASSERT_LESS_THAN(2 * PAGE_STEPS, sizeof(Pattern)); // only one page is in RAM
+
+    // step editing pages edits out to work records, not to the stored pattern
+    seq.setPatternLength(40);
+    for (uint8_t step = 0; step < 40; step++)
+    {
+        Note note;
+        note.pitch = step + 1;
+        note.octave = 1;
+        note.isRest = note.isTie = false;
+        seq.setStep(step);
+        seq.setPatternNote(note);
+    }
+    TEST_ASSERT_EQUAL(2, pattern.page);
+    TEST_ASSERT_FALSE(readPattern(STORE_PATTERNS - 1, pattern));
+    seq.setStep(5);
+    seq.getPatternNote(5);
+    TEST_ASSERT_EQUAL(6, pattern.note[5]);
+    TEST_ASSERT_EQUAL(0, pattern.page);
+
+    // a save waits for the edited pages paged out, then writes a record per
+    // page, the first one last
+    TEST_ASSERT_TRUE(savingPattern());
+    TEST_ASSERT_FALSE(savePattern(BANK_MAX - 1, PATTERN_MAX - 1));
+    finishSave();
+    TEST_ASSERT_TRUE(savePattern(BANK_MAX - 1, PATTERN_MAX - 1));
+    TEST_ASSERT_FALSE(savePattern(BANK_MAX - 1, 0)); // until it is written
+    finishSave();
+    simAdvance(100000);
+
+    // after a power cycle the pages are read back as the playhead gets to them
+    pattern = live;
+    patternStore.begin();
+    TEST_ASSERT_TRUE(seq.cuePattern(BANK_MAX - 1, PATTERN_MAX - 1));
+    TEST_ASSERT_EQUAL(40, pattern.length);
+    seq.setPatternLength(pattern.length);
+    seq.setBpm(500);
+    seq.play();
+    short last = -1;
+    uint8_t played = 0;
+    while (played < 40)
+    {
+        runFor(1);
+        short step = seq.selectStep(0);
+        if (step == last)
+            continue;
+        last = step;
+        played++;
+        TEST_ASSERT_EQUAL(step / PAGE_STEPS, pattern.page);
+        TEST_ASSERT_EQUAL(step + 1, pattern.note[step % PAGE_STEPS]);
+        TEST_ASSERT_TRUE(bitRead(sr.getData(), step % LED_STEPS)); // the lights follow the page
+    }
+
+    // a shorter save frees the pages past its end
+    seq.pause();
+    seq.setPatternLength(16);
+    savePattern(BANK_MAX - 1, PATTERN_MAX - 1);
+    finishSave();
+    simAdvance(100000);
+    patternStore.begin();
+    openPattern(STORE_PATTERNS - 1);
+    uint8_t packed[PATTERN_PACKED];
+    TEST_ASSERT_FALSE(patternStore.load(PatternStore::pageId(STORE_PATTERNS - 1, 1), packed));
+
+    pattern = live;
+    openPattern(0);
+}
+
+void test_a_save_in_progress_keeps_its_own_copy(void)
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    patternStore.begin();
+    Pattern live = pattern;
+    pattern.note[0] = 99;
+    savePattern(0, 6);
+    finishSave();
+
+    // a two page pattern, its second page edited and paged out
+    openPattern(5);
+    seq.setPatternLength(32);
+    Note note;
+    note.pitch = 5;
+    note.octave = 1;
+    note.isRest = note.isTie = false;
+    seq.setStep(20);
+    seq.setPatternNote(note);
+    seq.setStep(0);
+    seq.getPatternNote(0);
+    pattern.note[0] = 55;
+    editPage();
+    finishSave();
+    simAdvance(100000);
+    TEST_ASSERT_TRUE(savePattern(0, 5));
+
+    // another pattern opening before it is written neither waits for it, past
+    // the byte being programmed, nor changes it
+    uint64_t start = simTicks();
+    TEST_ASSERT_TRUE(seq.cuePattern(0, 6));
+    TEST_ASSERT_LESS_THAN(start + 3400 * SIM_TICKS_PER_US, simTicks());
+    TEST_ASSERT_EQUAL(99, pattern.note[0]);
+    TEST_ASSERT_TRUE(saveTo != STORE_NONE); // still being written
+
+    finishSave();
+    simAdvance(100000);
+    Pattern saved;
+    TEST_ASSERT_TRUE(readPattern(5, saved));
+    TEST_ASSERT_EQUAL(32, saved.length);
+    TEST_ASSERT_EQUAL(55, saved.note[0]);
+    uint8_t packed[PATTERN_PACKED];
+    TEST_ASSERT_TRUE(patternStore.load(PatternStore::pageId(5, 1), packed));
+    TEST_ASSERT_EQUAL(5, packed[2 + 20 % PAGE_STEPS]);
+
+    pattern = live;
+    seq.setPatternLength(16);
+    openPattern(0);
+}
+
+void test_a_full_store_keeps_slots_for_the_pages_leaving_ram(void)
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    patternStore.begin();
+    Pattern live = pattern;
+
+    // pattern pages fill the store up to the slots kept for the work records
+    uint8_t payload[STORE_PAYLOAD] = {16, 50};
+    uint8_t saved = 0;
+    while (patternStore.save(saved, payload))
+    {
+        simAdvance(100000);
+        saved++;
+    }
+    TEST_ASSERT_EQUAL(STORE_SLOTS - STORE_RESERVED, saved);
+    payload[2] = 1;
+    TEST_ASSERT_FALSE(patternStore.save(0, payload)); // a rewrite needs a slot as well
+
+    // a pattern save needs a slot for each new page and one for a rewrite, or
+    // it is refused before it writes anything
+    seq.setPatternLength(PATTERN_STEP_MAX);
+    uint8_t slot = STORE_PATTERNS - 1; // three new pages and a rewrite
+    for (uint8_t id = STORE_PAGES; id < STORE_PAGES + 3; id++)
+        patternStore.release(id);
+    uint32_t writes = simStats.eepromWrites;
+    TEST_ASSERT_FALSE(savePattern(BANK_MAX - 1, PATTERN_MAX - 1));
+    TEST_ASSERT_FALSE(savingPattern());
+    TEST_ASSERT_EQUAL(writes, simStats.eepromWrites);
+    patternStore.release(STORE_PAGES + 3);
+    TEST_ASSERT_TRUE(savePattern(BANK_MAX - 1, PATTERN_MAX - 1));
+    finishSave();
+    for (uint8_t page = 0; page < PATTERN_PAGE_MAX; page++)
+        TEST_ASSERT_TRUE(patternStore.has(PatternStore::pageId(slot, page)));
+
+    // the edits of every page leaving RAM still reach their work record, twice over
+    openPattern(STORE_PATTERNS - 1);
+    seq.setPatternLength(PATTERN_STEP_MAX);
+    for (uint8_t round = 1; round <= 2; round++)
+        for (uint8_t step = 0; step < PATTERN_STEP_MAX; step += PAGE_STEPS)
+        {
+            Note note;
+            note.pitch = round;
+            note.octave = 1;
+            note.isRest = note.isTie = false;
+            seq.setStep(step);
+            seq.setPatternNote(note);
+            finishSave();
+            simAdvance(100000);
+        }
+    for (uint8_t step = 0; step < PATTERN_STEP_MAX; step += PAGE_STEPS)
+    {
+        seq.getPatternNote(step);
+        TEST_ASSERT_EQUAL(2, pattern.note[0]);
+    }
+
+    pattern = live;
+    seq.setPatternLength(16);
+    openPattern(0);
+}
+
+void test_playback_never_waits_for_the_eeprom(void)
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    patternStore.begin();
+    Pattern live = pattern;
+
+    // two four page patterns, note n + 1 of the first at step n, of the second at step 63 - n
+    for (uint8_t slot = 1; slot <= 2; slot++)
+    {
+        openPattern(slot);
+        seq.setPatternLength(PATTERN_STEP_MAX);
+        for (uint8_t step = 0; step < PATTERN_STEP_MAX; step++)
+        {
+            Note note;
+            note.pitch = (slot == 1 ? step : PATTERN_STEP_MAX - 1 - step) % 12 + 1;
+            note.octave = (slot == 1 ? step : PATTERN_STEP_MAX - 1 - step) / 12 + 1;
+            note.isRest = note.isTie = false;
+            seq.setStep(step);
+            seq.setPatternNote(note);
+        }
+        finishSave();
+        TEST_ASSERT_TRUE(savePattern(0, slot));
+        finishSave();
+    }
+
+    // chaos turns a page on almost every step, while song saves keep the EEPROM busy
+    TEST_ASSERT_TRUE(seq.cuePattern(0, 1));
+    seq.setPatternLength(pattern.length);
+    playMode = CHAOS;
+    seq.setBpm(MAX_BPM);
+    runFor(30); // the clock ticks queued meanwhile pass while paused
+    seq.play();
+    uint64_t stalls = simStats.eepromReadStalls;
+    uint8_t busyBytes[4] = {0, 0, 0, 0};
+    bool cued = false;
+    uint8_t turns = 0, page = pattern.page;
+    short last = -1;
+    for (uint16_t played = 0; played < 3 * PATTERN_STEP_MAX;)
+    {
+        if (!patternStore.busy())
+        {
+            if (played >= PATTERN_STEP_MAX && !cued)
+                cued = seq.cuePattern(0, 2); // the second opens on a downbeat during the saves
+            busyBytes[played & 3]++;
+            patternStore.save(STORE_SONG, busyBytes, sizeof(busyBytes));
+        }
+        runFor(1);
+        short step = seq.selectStep(0);
+        if (step == last)
+            continue;
+        last = step;
+        played++;
+        turns += pattern.page != page;
+        page = pattern.page;
+        bool second = cued && !seq.hasCuedPattern();
+        TEST_ASSERT_EQUAL(second ? PATTERN_STEP_MAX - step : step + 1, pattern.note[step % PAGE_STEPS]);
+    }
+    TEST_ASSERT_TRUE(cued && !seq.hasCuedPattern());
+    TEST_ASSERT_GREATER_THAN(PATTERN_STEP_MAX, turns);
+    TEST_ASSERT_EQUAL(stalls, simStats.eepromReadStalls);
+
+    seq.pause();
+    playMode = FORWARD;
+    finishSave();
+    simAdvance(100000);
+    pattern = live;
+    seq.setPatternLength(16);
+    openPattern(0);
+}
+
+void test_edited_pages_leave_ram_without_waiting(void)
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    patternStore.begin();
+    Pattern live = pattern;
+    openPattern(7);
+    seq.setPatternLength(PATTERN_STEP_MAX);
+
+    // every page edited and paged out twice while a song save holds the store
+    uint8_t busyBytes[sizeof(Song)] = {1};
+    patternStore.save(STORE_SONG, busyBytes, sizeof(busyBytes));
+    uint64_t start = simTicks();
+    for (uint8_t round = 1; round <= 2; round++)
+        for (uint8_t step = 0; step < PATTERN_STEP_MAX; step += PAGE_STEPS)
+        {
+            Note note;
+            note.pitch = round;
+            note.octave = 1;
+            note.isRest = note.isTie = false;
+            seq.setStep(step);
+            seq.setPatternNote(note);
+        }
+    seq.setStep(0);
+    seq.getPatternNote(0);
+    TEST_ASSERT_EQUAL(start, simTicks());
+    TEST_ASSERT_TRUE(patternStore.busy());
+    TEST_ASSERT_TRUE(savingPattern()); // a save waits for the pages queued
+
+    // each page reaches its work record with its last edit
+    finishSave();
+    simAdvance(100000);
+    for (uint8_t page = 1; page < PATTERN_PAGE_MAX; page++)
+    {
+        uint8_t packed[PATTERN_PACKED];
+        TEST_ASSERT_TRUE(patternStore.load(STORE_WORK + page, packed));
+        TEST_ASSERT_EQUAL(2, packed[2]);
+    }
+
+    pattern = live;
+    seq.setPatternLength(16);
+    openPattern(0);
+}
+
+int main(int argc, char **argv)
+{
+    pattern.length = 16;
+    pattern.shuffle = 50;
+    seq.setPatternLength(16);
+    cv.setPitchSource(pitchCV);
+    cv.begin(STEPCLOCK_RATE);
+    seq.begin();
+    encoders.begin();
+    buttonScanner.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_internal_clock_plays_two_steps_per_beat);
+    RUN_TEST(test_internal_clock_does_not_drift_under_loop_load);
+    RUN_TEST(test_gate_length_follows_shuffled_step);
+    RUN_TEST(test_external_clock_plays_a_step_per_pulse);
+    RUN_TEST(test_external_clock_isr_only_queues_the_pulse);
+    RUN_TEST(test_external_clock_ratios);
+    RUN_TEST(test_clock_tracker_rejects_a_single_jittery_pulse);
+    RUN_TEST(test_glide_follows_curve);
+    RUN_TEST(test_cv_output_rate_ignores_loop_load);
+    RUN_TEST(test_dac_skips_unchanged_words);
+    RUN_TEST(test_dac_latches_both_channels_together);
+    RUN_TEST(test_bcm_shows_brightness_in_eight_interrupts_per_frame);
+    RUN_TEST(test_bcm_keeps_its_timing_when_the_isr_is_entered_late);
+    RUN_TEST(test_leds_have_their_own_gamma_corrected_level);
+    RUN_TEST(test_led_changes_show_only_once_published);
+    RUN_TEST(test_led_animations_run_without_the_loop);
+    RUN_TEST(test_dialog_overlay_leaves_the_step_layer_alone);
+    RUN_TEST(test_step_lights_show_the_page_by_level);
+    RUN_TEST(test_encoder_detents_are_counted_in_the_isr);
+    RUN_TEST(test_fast_turns_accelerate_the_tempo_knob);
+    RUN_TEST(test_buttons_are_debounced_in_the_adc_isr);
+    RUN_TEST(test_pattern_saves_in_the_background);
+    RUN_TEST(test_old_layouts_migrate_on_first_boot);
+    RUN_TEST(test_cued_pattern_switches_on_the_downbeat);
+    RUN_TEST(test_song_chains_patterns_on_the_downbeat);
+    RUN_TEST(test_long_patterns_play_a_page_at_a_time);
+    RUN_TEST(test_a_save_in_progress_keeps_its_own_copy);
+    RUN_TEST(test_a_full_store_keeps_slots_for_the_pages_leaving_ram);
+    RUN_TEST(test_playback_never_waits_for_the_eeprom);
+    RUN_TEST(test_edited_pages_leave_ram_without_waiting);
+    return UNITY_END();
+}
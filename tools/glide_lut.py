@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Generates the dense glide curve tables in include/glide.h.
+
+Each curve is defined by 30 control points (x in 1/100 of a 0..30 range,
+y in percent) joined by smoothstep segments. The firmware used to evaluate
+that spline on every pitch update; the tables sample it at GLIDE_LUT_SIZE
+evenly spaced positions as Q16 fractions of the glide, so getPitch() is a
+single lookup.
+
+    python3 tools/glide_lut.py > /tmp/lut.h
+"""
+
+LUT_SIZE = 256
+RESOLUTION = 30
+
+CURVES = {
+    "A": (
+        [158, 312, 462, 608, 750, 888, 1022, 1152, 1278, 1400, 1518, 1632, 1742, 1848, 1950,
+         2048, 2142, 2232, 2318, 2400, 2478, 2552, 2622, 2688, 2750, 2808, 2862, 2912, 2958, 3000],
+        [1, 3, 5, 6, 8, 10, 13, 15, 17, 20, 23, 26, 29, 32, 35,
+         38, 42, 46, 49, 53, 57, 62, 66, 70, 75, 80, 85, 90, 95, 100],
+    ),
+    "B": (
+        [42, 88, 138, 192, 250, 312, 378, 448, 522, 600, 682, 768, 858, 952, 1050,
+         1152, 1258, 1368, 1482, 1600, 1722, 1848, 1978, 2112, 2250, 2392, 2538, 2688, 2842, 3000],
+        [5, 10, 15, 20, 25, 30, 34, 38, 43, 47, 51, 54, 58, 62, 65,
+         68, 71, 74, 77, 80, 83, 85, 87, 90, 92, 94, 95, 97, 99, 100],
+    ),
+    "C": (
+        [1, 200, 300, 400, 500, 600, 700, 800, 900, 1000, 1100, 1200, 1300, 1400, 1500,
+         1600, 1700, 1800, 1900, 2000, 2100, 2200, 2300, 2400, 2500, 2600, 2700, 2800, 2900, 3000],
+        [3, 7, 10, 13, 17, 20, 23, 27, 30, 33, 37, 40, 43, 47, 50,
+         53, 57, 60, 63, 67, 70, 73, 77, 80, 83, 87, 90, 93, 97, 100],
+    ),
+}
+
+
+def smooth_step(xs, ys, point_x):
+    """The spline the firmware evaluated before the tables existed."""
+    x = [v / 100.0 for v in xs]
+    y = [v / 100.0 for v in ys]
+    if point_x <= x[0]:
+        return y[0]
+    if point_x >= x[-1]:
+        return y[-1]
+    i = 0
+    while point_x >= x[i + 1]:
+        i += 1
+    if point_x == x[i + 1]:
+        return y[i + 1]
+    t = (point_x - x[i]) / (x[i + 1] - x[i])
+    t = t * t * (3 - 2 * t)
+    return y[i] * (1 - t) + y[i + 1] * t
+
+
+def main():
+    print("// generated by tools/glide_lut.py, do not edit")
+    for name, (xs, ys) in CURVES.items():
+        values = []
+        for i in range(LUT_SIZE):
+            position = i / LUT_SIZE
+            values.append(min(65535, round(smooth_step(xs, ys, position * RESOLUTION) * 65535)))
+        print("const uint16_t glideCurve%s[GLIDE_LUT_SIZE] PROGMEM = {" % name)
+        for row in range(0, LUT_SIZE, 16):
+            print("    " + ", ".join("%5d" % v for v in values[row:row + 16]) + ",")
+        print("};")
+
+
+if __name__ == "__main__":
+    main()